@@ -4,9 +4,12 @@
 
 #include "eqparse.h"
 
+#include <algorithm> // for rotate()
+
 
 void quaternion_julia_set_equation_parser::cleanup(void)
 {
+	cached_formula_index = formula_cache.size();
 	unique_formula_string = "";
 	answers.clear();
 	constant_scratch_heap.clear();
@@ -23,6 +26,14 @@ float quaternion_julia_set_equation_parser::iterate(const quaternion &src_Z, con
 	float len_sq = Z.self_dot();
 	const float threshold_sq = threshold*threshold;
 
+	// Periodicity checking (Brent's method): compare the orbit against a saved point, and move the
+	// saved point forward after 1, 2, 4, ... steps. If the orbit comes back to the saved point,
+	// it has settled into a cycle and will never escape, so the point is inside the set.
+	const float periodicity_epsilon_sq = periodicity_epsilon*periodicity_epsilon;
+	quaternion saved_Z = Z;
+	size_t check_interval = 1;
+	size_t steps_since_save = 0;
+
 	for(short unsigned int i = 0; i < max_iterations; i++)
 	{
 		for(size_t i = 0; i < execution_stack.size(); i++)
@@ -30,6 +41,21 @@ float quaternion_julia_set_equation_parser::iterate(const quaternion &src_Z, con
 
 		if((len_sq = Z.self_dot()) >= threshold_sq)
 			break;
+
+		if(0 < periodicity_epsilon)
+		{
+			quaternion diff(Z.x - saved_Z.x, Z.y - saved_Z.y, Z.z - saved_Z.z, Z.w - saved_Z.w);
+
+			if(diff.self_dot() < periodicity_epsilon_sq)
+				break;
+
+			if(++steps_since_save == check_interval)
+			{
+				saved_Z = Z;
+				steps_since_save = 0;
+				check_interval *= 2;
+			}
+		}
 	}
 
 	return sqrt(len_sq);
@@ -2788,6 +2814,11 @@ bool quaternion_julia_set_equation_parser::setup(const string &src_formula, stri
 		//	cout << endl;
 
 
+		// skip compiling if this formula has been seen before with this C
+		if(true == load_from_formula_cache())
+			return true;
+
+
 
 		vector<term> ordered_terms;
 		get_terms(equation, ordered_terms);
@@ -2830,9 +2861,63 @@ bool quaternion_julia_set_equation_parser::setup(const string &src_formula, stri
 			return false;
 		}
 
+		store_in_formula_cache();
+
 		return true;
 }
 
+bool quaternion_julia_set_equation_parser::load_from_formula_cache(void)
+{
+	for(size_t i = 0; i < formula_cache.size(); i++)
+	{
+		const compiled_formula &f = formula_cache[i];
+
+		if( f.unique_formula_string != unique_formula_string ||
+			f.C.x != C.x || f.C.y != C.y || f.C.z != C.z || f.C.w != C.w )
+			continue;
+
+		answers = f.answers;
+		constant_scratch_heap = f.constant_scratch_heap;
+		instructions = f.instructions;
+		scratch_heap = f.scratch_heap;
+
+		// the execution stack points into this object's own heaps, so it has to be rebuilt
+		if(false == assemble_compiled_instructions())
+		{
+			cleanup();
+			return false;
+		}
+
+		// keep the cache in order of last use, so that the least recently used entry is the one dropped
+		rotate(formula_cache.begin() + i, formula_cache.begin() + i + 1, formula_cache.end());
+		cached_formula_index = formula_cache.size() - 1;
+
+		return true;
+	}
+
+	return false;
+}
+
+void quaternion_julia_set_equation_parser::store_in_formula_cache(void)
+{
+	// drop the least recently used entry once full
+	if(formula_cache.size() >= max_compiled_formula_cache_size)
+		formula_cache.erase(formula_cache.begin());
+
+	compiled_formula f;
+
+	f.unique_formula_string = unique_formula_string;
+	f.C = C;
+	f.answers = answers;
+	f.constant_scratch_heap = constant_scratch_heap;
+	f.instructions = instructions;
+	f.scratch_heap = scratch_heap;
+
+	formula_cache.push_back(f);
+
+	cached_formula_index = formula_cache.size() - 1;
+}
+
 bool quaternion_julia_set_equation_parser::compile_ordered_terms(const vector<term> &ordered_terms)
 {
 	try
@@ -2942,15 +3027,23 @@ bool quaternion_julia_set_equation_parser::compile_ordered_terms(const vector<te
 
 string quaternion_julia_set_equation_parser::emit_fragment_shader_code(void)
 {
+	if(cached_formula_index < formula_cache.size() && "" != formula_cache[cached_formula_index].fragment_shader_code)
+		return formula_cache[cached_formula_index].fragment_shader_code;
+
 	string code;
 
 	code += "#version 110\n";
 	code += "\n";
-	code += "uniform sampler2D z_xyz;\n";
+	code += "uniform float grid_min;\n";
+	code += "uniform float step_size;\n";
+	code += "uniform float first_slab;\n";
+	code += "uniform float tile_size;\n";
+	code += "uniform float tile_columns;\n";
 	code += "uniform float z_w;\n";
 	code += "uniform vec4 c;\n";
 	code += "uniform int max_iterations;\n";
 	code += "uniform float threshold;\n";
+	code += "uniform float periodicity_epsilon;\n";
 
 	code += "\n";
 	code += q_math.emit_function_definitions_fragment_shader_code();
@@ -2958,22 +3051,53 @@ string quaternion_julia_set_equation_parser::emit_fragment_shader_code(void)
 	code += emit_execution_stack_fragment_shader_code();
 	code += "\n";
 
-	code += "float iterate(vec4 z)\n";
+	code += emit_iterate_fragment_shader_code();
+	code += "\n";
+	code += "void main(void)\n";
 	code += "{\n";
-	code += "    float threshold_sq = threshold*threshold;\n";
+	code += "    // the target is an atlas of res x res tiles, one slab per tile, filled row by row\n";
+	code += "    vec2 tile = floor(gl_FragCoord.xy / tile_size);\n";
+	code += "    vec2 pixel = floor(gl_FragCoord.xy) - tile*tile_size;\n";
+	code += "    float slab = first_slab + tile.y*tile_columns + tile.x;\n";
 	code += "\n";
-	code += "    float len_sq = dot(z, z);\n";
+	code += "    // pixel (i, j) of a tile holds grid point x = j, y = i, so that rows of the read back slab run along y\n";
+	code += "    vec2 xy = vec2(grid_min) + pixel.yx*step_size;\n";
+	code += "    vec4 z = vec4(xy, grid_min + slab*step_size, z_w);\n";
 	code += "\n";
-	code += "    for(int i = 0; i < max_iterations; i++)\n";
-	code += "    {\n";
-	code += "        z = iter_func(z);\n";
+	code += "    // only whether the point is in the set is read back, as one byte\n";
+	code += "    float in_set = (iterate(z) < threshold) ? 1.0 : 0.0;\n";
+	code += "    gl_FragData[0] = vec4(in_set, in_set, in_set, in_set);\n";
+	code += "}\n";
+
+	if(cached_formula_index < formula_cache.size())
+		formula_cache[cached_formula_index].fragment_shader_code = code;
+
+	return code;
+}
+
+string quaternion_julia_set_equation_parser::emit_point_list_fragment_shader_code(void)
+{
+	if(cached_formula_index < formula_cache.size() && "" != formula_cache[cached_formula_index].point_list_fragment_shader_code)
+		return formula_cache[cached_formula_index].point_list_fragment_shader_code;
+
+	string code;
+
+	code += "#version 110\n";
 	code += "\n";
-	code += "        if((len_sq = dot(z, z)) >= threshold_sq)\n";
-	code += "            break;\n";
-	code += "    }\n";
+	code += "uniform sampler2D z_xyz;\n";
+	code += "uniform float z_w;\n";
+	code += "uniform vec4 c;\n";
+	code += "uniform int max_iterations;\n";
+	code += "uniform float threshold;\n";
+	code += "uniform float periodicity_epsilon;\n";
+
 	code += "\n";
-	code += "    return sqrt(len_sq);\n";
-	code += "}\n";
+	code += q_math.emit_function_definitions_fragment_shader_code();
+	code += "\n";
+	code += emit_execution_stack_fragment_shader_code();
+	code += "\n";
+
+	code += emit_iterate_fragment_shader_code();
 	code += "\n";
 	code += "void main(void)\n";
 	code += "{\n";
@@ -2983,22 +3107,39 @@ string quaternion_julia_set_equation_parser::emit_fragment_shader_code(void)
 	code += "    gl_FragData[0].rgb = vec3(length, length, length);\n";
 	code += "}\n";
 
+	if(cached_formula_index < formula_cache.size())
+		formula_cache[cached_formula_index].point_list_fragment_shader_code = code;
+
 	return code;
 }
 
 
 string quaternion_julia_set_equation_parser::emit_vertex_interp_fragment_shader_code(void)
 {
+	if(cached_formula_index < formula_cache.size() && "" != formula_cache[cached_formula_index].vertex_interp_fragment_shader_code)
+		return formula_cache[cached_formula_index].vertex_interp_fragment_shader_code;
+
 	string code;
 
 	code += "#version 110\n";
 	code += "\n";
-	code += "uniform sampler1D input0;\n";
-	code += "uniform sampler1D input1;\n";
+	code += "uniform sampler2D pyramid;\n";
+	code += "uniform vec2 pyramid_atlas_size;\n";
+	code += "uniform float pyramid_base_size;\n";
+	code += "uniform int pyramid_levels;\n";
+	code += "uniform sampler2D slabs;\n";
+	code += "uniform sampler2D mc_tables;\n";
+	code += "uniform float table_rows;\n";
+	code += "uniform float grid_res;\n";
+	code += "uniform float grid_min;\n";
+	code += "uniform float step_size;\n";
+	code += "uniform float cube_z;\n";
+	code += "uniform float output_width;\n";
 	code += "uniform float z_w;\n";
 	code += "uniform vec4 c;\n";
 	code += "uniform int max_iterations;\n";
 	code += "uniform float threshold;\n";
+	code += "uniform float periodicity_epsilon;\n";
 	code += "uniform int vertex_refinement_steps;\n";
 
 	code += "\n";
@@ -3007,58 +3148,13 @@ string quaternion_julia_set_equation_parser::emit_vertex_interp_fragment_shader_
 	code += emit_execution_stack_fragment_shader_code();
 	code += "\n";
 
-	code += "float iterate(vec4 z)\n";
-	code += "{\n";
-	code += "    float threshold_sq = threshold*threshold;\n";
-	code += "\n";
-	code += "    float len_sq = dot(z, z);\n";
-	code += "\n";
-	code += "    for(int i = 0; i < max_iterations; i++)\n";
-	code += "    {\n";
-	code += "        z = iter_func(z);\n";
-	code += "\n";
-	code += "        if((len_sq = dot(z, z)) >= threshold_sq)\n";
-	code += "            break;\n";
-	code += "    }\n";
-	code += "\n";
-	code += "    return sqrt(len_sq);\n";
-	code += "}\n";
-	code += "\n";
-
-	code += "int lessthan(vec4 left, vec4 right)\n";
-	code += "{\n";
-	code += "    if(left.x < right.x)\n";
-	code += "        return 1;\n";
-	code += "    else if(left.x > right.x)\n";
-	code += "        return 0;\n";
-	code += "\n";
-	code += "    if(left.y < right.y)\n";
-	code += "        return 1;\n";
-	code += "    else if(left.y > right.y)\n";
-	code += "        return 0;\n";
+	code += emit_iterate_fragment_shader_code();
 	code += "\n";
-	code += "    if(left.z < right.z)\n";
-	code += "        return 1;\n";
-	code += "    else if(left.z > right.z)\n";
-	code += "        return 0;\n";
-	code += "\n";
-	code += "    return 0;\n";
-	code += "}\n";
 
+	// v0 is always the low end of an edge, and both ends are made the same way from the
+	// cube and edge, so the ends do not need to be sorted to get bit-identical results.
 	code += "vec3 vertex_interp(vec4 v0, vec4 v1)\n";
 	code += "{\n";
-	// Sort the vertices so that way the same two vertices will always produce the same result
-	// regardless of the order in which they were passed into the function.
-	//
-	// This may seem unnecessary, but adding two floats can produce different results depending
-	// on their order, if the very rightmost decimal places are in use.
-	code += "    if(0 == lessthan(v0, v1))\n";
-	code += "    {\n";
-	code += "        vec4 temp = v0;\n";
-	code += "        v0 = v1;\n";
-	code += "        v1 = temp;\n";
-	code += "    }\n";
-	code += "\n";
 	code += "    // Start half-way between the vertices.\n";
 	code += "    vec3 result = (v0.xyz + v1.xyz)*0.5;\n";
 	code += "\n";
@@ -3099,20 +3195,195 @@ string quaternion_julia_set_equation_parser::emit_vertex_interp_fragment_shader_
 	code += "}\n";
 	code += "\n";
 
+	code += "// position of a corner of the cube, with w = 1.0 if it is outside of the set\n";
+	code += "vec4 grid_point(vec2 cube, vec3 corner)\n";
+	code += "{\n";
+	code += "    vec3 p = vec3(cube, cube_z) + corner;\n";
+	code += "    vec2 t = (p.xy + 0.5)/grid_res;\n";
+	code += "    vec4 slab_pair = texture2D(slabs, t);\n";
+	code += "    float in_set = (corner.z < 0.5) ? slab_pair.r : slab_pair.a;\n";
+	code += "\n";
+	code += "    return vec4(vec3(grid_min) + p*step_size, (in_set < 0.5) ? 1.0 : 0.0);\n";
+	code += "}\n";
+	code += "\n";
+
 	code += "void main(void)\n";
 	code += "{\n";
-	code += "    vec4 v0 = texture1D(input0, gl_TexCoord[0].s);\n";
-	code += "    vec4 v1 = texture1D(input1, gl_TexCoord[0].s);\n";
+	code += "    // this fragment's index into the compacted edge list\n";
+	code += "    float k = floor(gl_FragCoord.y)*output_width + floor(gl_FragCoord.x);\n";
+	code += "\n";
+	code += "    // walk down the pyramid to the cube that holds edge k; each cell holds the running totals\n";
+	code += "    // of its children (0, 0), (1, 0), (0, 1), (1, 1), which lists the cubes in Morton order\n";
+	code += "    vec2 cube = vec2(0.0, 0.0);\n";
+	code += "    float level_size = 1.0;\n";
+	code += "\n";
+	code += "    for(int i = 0; i < pyramid_levels; i++)\n";
+	code += "    {\n";
+	code += "        vec4 totals = texture2D(pyramid, (vec2(2.0*(pyramid_base_size - level_size), 0.0) + cube + 0.5)/pyramid_atlas_size);\n";
+	code += "\n";
+	code += "        level_size *= 2.0;\n";
+	code += "        cube *= 2.0;\n";
+	code += "\n";
+	code += "        if(k >= totals.b)\n";
+	code += "        {\n";
+	code += "            k -= totals.b;\n";
+	code += "            cube += vec2(1.0, 1.0);\n";
+	code += "        }\n";
+	code += "        else if(k >= totals.g)\n";
+	code += "        {\n";
+	code += "            k -= totals.g;\n";
+	code += "            cube.y += 1.0;\n";
+	code += "        }\n";
+	code += "        else if(k >= totals.r)\n";
+	code += "        {\n";
+	code += "            k -= totals.r;\n";
+	code += "            cube.x += 1.0;\n";
+	code += "        }\n";
+	code += "    }\n";
+	code += "\n";
+	code += "    // k is now the index among the cube's edges that have a vertex on them, in edge order\n";
+	code += "    float case_index = texture2D(pyramid, (cube + 0.5)/pyramid_atlas_size).r;\n";
+	code += "    float table_x = (case_index + 0.5)/256.0;\n";
+	code += "    vec4 edge = texture2D(mc_tables, vec2(table_x, (k + 1.5)/table_rows));\n";
+	code += "    vec3 direction = mod(floor(vec3(edge.a)/vec3(1.0, 2.0, 4.0)), 2.0);\n";
+	code += "\n";
+	code += "    gl_FragData[0].rgba = vec4(vertex_interp(grid_point(cube, edge.rgb), grid_point(cube, edge.rgb + direction)), 0.0);\n";
+	code += "}\n";
+
+	if(cached_formula_index < formula_cache.size())
+		formula_cache[cached_formula_index].vertex_interp_fragment_shader_code = code;
+
+	return code;
+}
+
+
+
+
+
+string quaternion_julia_set_equation_parser::emit_cube_case_fragment_shader_code(void)
+{
+	// This one does not depend on the formula, so there is nothing to cache.
+	string code;
+
+	code += "#version 110\n";
+	code += "\n";
+	code += "uniform sampler2D slabs;\n";
+	code += "uniform sampler2D mc_tables;\n";
+	code += "uniform float table_rows;\n";
+	code += "uniform float grid_res;\n";
+	code += "\n";
+
+	code += "// r = 1.0 if the grid point below is in the set, a = 1.0 if the grid point above is in the set\n";
+	code += "vec4 in_set(vec2 p)\n";
+	code += "{\n";
+	code += "    return step(0.5, texture2D(slabs, (p + 0.5)/grid_res));\n";
+	code += "}\n";
+	code += "\n";
+
+	code += "void main(void)\n";
+	code += "{\n";
+	code += "    vec2 cube = floor(gl_FragCoord.xy);\n";
+	code += "\n";
+	code += "    vec4 corners_0_3 = in_set(cube);\n";
+	code += "    vec4 corners_1_2 = in_set(cube + vec2(1.0, 0.0));\n";
+	code += "    vec4 corners_4_7 = in_set(cube + vec2(0.0, 1.0));\n";
+	code += "    vec4 corners_5_6 = in_set(cube + vec2(1.0, 1.0));\n";
+	code += "\n";
+	code += "    // bit i is set if corner i is in the set, with the corners numbered as in mc_corner_offsets\n";
+	code += "    float case_index = corners_0_3.r + corners_1_2.r*2.0 + corners_1_2.a*4.0 + corners_0_3.a*8.0\n";
+	code += "                     + corners_4_7.r*16.0 + corners_5_6.r*32.0 + corners_5_6.a*64.0 + corners_4_7.a*128.0;\n";
 	code += "\n";
-	code += "    gl_FragData[0].rgba = vec4(vertex_interp(v0, v1), 0.0);\n";
+	code += "    // r = the case index, a = the number of edges with a vertex on them\n";
+	code += "    float edge_count = texture2D(mc_tables, vec2((case_index + 0.5)/256.0, 0.5/table_rows)).r;\n";
+	code += "\n";
+	code += "    gl_FragData[0] = vec4(case_index, 0.0, 0.0, edge_count);\n";
 	code += "}\n";
 
 	return code;
 }
 
+string quaternion_julia_set_equation_parser::emit_count_reduction_fragment_shader_code(void)
+{
+	// This one does not depend on the formula, so there is nothing to cache.
+	string code;
 
+	code += "#version 110\n";
+	code += "\n";
+	code += "uniform sampler2D pyramid;\n";
+	code += "uniform vec2 pyramid_atlas_size;\n";
+	code += "uniform float level_below_offset;\n";
+	code += "\n";
 
+	code += "float pyramid_count(vec2 cell)\n";
+	code += "{\n";
+	code += "    return texture2D(pyramid, (vec2(level_below_offset, 0.0) + cell + 0.5)/pyramid_atlas_size).a;\n";
+	code += "}\n";
+	code += "\n";
 
+	code += "void main(void)\n";
+	code += "{\n";
+	code += "    // running totals over a 2 x 2 block of the level below, in Morton order; a is the block's total\n";
+	code += "    vec2 cell = floor(gl_FragCoord.xy)*2.0;\n";
+	code += "\n";
+	code += "    vec4 totals;\n";
+	code += "    totals.r = pyramid_count(cell);\n";
+	code += "    totals.g = totals.r + pyramid_count(cell + vec2(1.0, 0.0));\n";
+	code += "    totals.b = totals.g + pyramid_count(cell + vec2(0.0, 1.0));\n";
+	code += "    totals.a = totals.b + pyramid_count(cell + vec2(1.0, 1.0));\n";
+	code += "\n";
+	code += "    gl_FragData[0] = totals;\n";
+	code += "}\n";
+
+	return code;
+}
+
+// Must match iterate() on the CPU side.
+string quaternion_julia_set_equation_parser::emit_iterate_fragment_shader_code(void)
+{
+	string code;
+
+	code += "float iterate(vec4 z)\n";
+	code += "{\n";
+	code += "    float threshold_sq = threshold*threshold;\n";
+	code += "    float periodicity_epsilon_sq = periodicity_epsilon*periodicity_epsilon;\n";
+	code += "\n";
+	code += "    float len_sq = dot(z, z);\n";
+	code += "\n";
+	code += "    vec4 saved_z = z;\n";
+	code += "    int check_interval = 1;\n";
+	code += "    int steps_since_save = 0;\n";
+	code += "\n";
+	code += "    for(int i = 0; i < max_iterations; i++)\n";
+	code += "    {\n";
+	code += "        z = iter_func(z);\n";
+	code += "\n";
+	code += "        if((len_sq = dot(z, z)) >= threshold_sq)\n";
+	code += "            break;\n";
+	code += "\n";
+	code += "        // Periodicity checking: an orbit that returns to a saved point is in a cycle, and will never escape.\n";
+	code += "        if(0.0 < periodicity_epsilon)\n";
+	code += "        {\n";
+	code += "            vec4 diff = z - saved_z;\n";
+	code += "\n";
+	code += "            if(dot(diff, diff) < periodicity_epsilon_sq)\n";
+	code += "                break;\n";
+	code += "\n";
+	code += "            steps_since_save++;\n";
+	code += "\n";
+	code += "            if(steps_since_save == check_interval)\n";
+	code += "            {\n";
+	code += "                saved_z = z;\n";
+	code += "                steps_since_save = 0;\n";
+	code += "                check_interval *= 2;\n";
+	code += "            }\n";
+	code += "        }\n";
+	code += "    }\n";
+	code += "\n";
+	code += "    return sqrt(len_sq);\n";
+	code += "}\n";
+
+	return code;
+}
 
 string quaternion_julia_set_equation_parser::emit_execution_stack_fragment_shader_code(void)
 {
@@ -81,21 +81,53 @@ public:
 	qmath_func_ptr f;
 };
 
+// A formula that has already been compiled and assembled, along with the shader code emitted for it.
+// Entries are keyed by the unique formula string and C, since constant terms are folded using C.
+class compiled_formula
+{
+public:
+	string unique_formula_string;
+	quaternion C;
+
+	vector< quaternion > answers;
+	vector< quaternion > constant_scratch_heap;
+	vector<	vector<tokenized_instruction> > instructions;
+	vector< vector< quaternion > > scratch_heap;
+
+	string fragment_shader_code;
+	string point_list_fragment_shader_code;
+	string vertex_interp_fragment_shader_code;
+};
+
+// Enough for a parameter sweep to revisit recent values of C without the cache growing without bound.
+// Once full, the least recently used formula is dropped.
+const size_t max_compiled_formula_cache_size = 64;
+
 class quaternion_julia_set_equation_parser
 {
 public:
-	quaternion_julia_set_equation_parser() { setup_function_map(); }
+	quaternion_julia_set_equation_parser() { periodicity_epsilon = 0; cached_formula_index = 0; setup_function_map(); }
 	~quaternion_julia_set_equation_parser() { cleanup(); }
 	bool setup(const string &src_formula, string &error_output, const quaternion &src_C);
 	float iterate(const quaternion &src_Z, const short unsigned int &max_iterations, const float &threshold);
 	string get_unique_formula_string(void);
 	string emit_fragment_shader_code(void);
+	string emit_point_list_fragment_shader_code(void);
 	string emit_vertex_interp_fragment_shader_code(void);
+	string emit_cube_case_fragment_shader_code(void);
+	string emit_count_reduction_fragment_shader_code(void);
+
+	// A positive epsilon enables periodicity checking, so that orbits caught in a cycle stop early; 0 disables it.
+	inline void set_periodicity_epsilon(const float src_epsilon) { periodicity_epsilon = src_epsilon; }
+	inline float get_periodicity_epsilon(void) { return periodicity_epsilon; }
 
 protected:
+	string emit_iterate_fragment_shader_code(void);
 	string emit_execution_stack_fragment_shader_code(void);
 	void setup_function_map(void);
 	void cleanup(void);
+	bool load_from_formula_cache(void);
+	void store_in_formula_cache(void);
 	qmath_func_ptr get_function_instruction(const string &src_token);
 	void setup_constant_quaternion(const vector<string> &tokens, const size_t &ordered_term_index);
 	void setup_variable_quaternion(const vector<string> &tokens, const size_t &ordered_term_index);
@@ -121,6 +153,7 @@ protected:
 	bool assemble_compiled_instructions(void);
 
 	quaternion Z, C;
+	float periodicity_epsilon;
 	quaternion_math q_math;
 	string unique_formula_string;
 
@@ -130,6 +163,9 @@ protected:
 	vector< vector< quaternion > > scratch_heap;
 	vector< assembled_instruction > execution_stack;
 	vector< function_mapping > function_map;
+
+	vector< compiled_formula > formula_cache;
+	size_t cached_formula_index;
 };
 
 #endif
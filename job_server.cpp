@@ -0,0 +1,298 @@
+// Source code by Shawn Halayka
+// Source code is in the public domain
+
+#include "job_server.h"
+
+#include <algorithm> // for sort()
+#include <chrono>
+#include <system_error>
+#include <thread>
+
+#include <exception>
+using std::exception;
+
+#include <new>
+using std::bad_alloc;
+
+#include <typeinfo>
+
+
+job_server::job_server(quaternion_julia_set &src_qjs, const string &src_spool_directory, const size_t src_memory_budget_bytes) : qjs(src_qjs)
+{
+	spool_directory = src_spool_directory;
+	memory_budget_bytes = src_memory_budget_bytes;
+	jobs_run = 0;
+	last_progress_stage = "";
+}
+
+bool job_server::report_progress(const char *const stage_name, const float fraction, void *user_data)
+{
+	job_server *server = static_cast<job_server *>(user_data);
+
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	// Keep the status file current, without rewriting it on every slab.
+	if(server->last_progress_stage != stage_name || now - server->last_progress_time > std::chrono::milliseconds(500))
+	{
+		ostringstream oss;
+		oss << stage_name << ", " << static_cast<int>(fraction*100) << "%";
+
+		server->write_status(server->current_job_path, "running", "", true, oss.str());
+
+		server->last_progress_stage = stage_name;
+		server->last_progress_time = now;
+	}
+
+	// Cancel the running job once a <job>.cancel file shows up in the spool directory.
+	std::error_code ec;
+
+	return false == std::filesystem::exists(server->current_cancel_path, ec);
+}
+
+bool job_server::run(void)
+{
+	std::error_code ec;
+
+	if(false == std::filesystem::is_directory(spool_directory, ec))
+	{
+		status_string = "Spool directory does not exist: ";
+		status_string += spool_directory.string();
+		return false;
+	}
+
+	cout << "Watching spool directory " << spool_directory.string() << " for jobs" << endl;
+
+	const std::filesystem::path stop_path = spool_directory / "stop";
+
+	while(false == std::filesystem::exists(stop_path, ec))
+	{
+		std::filesystem::path job_path;
+
+		if(false == get_next_job(job_path))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(250));
+			continue;
+		}
+
+		run_job(job_path);
+	}
+
+	std::filesystem::remove(stop_path, ec);
+
+	cout << "Stopping after " << jobs_run << " job(s)" << endl;
+
+	status_string = "OK";
+	return true;
+}
+
+bool job_server::get_next_job(std::filesystem::path &job_path)
+{
+	vector<std::filesystem::path> job_paths;
+	std::error_code ec;
+
+	for(std::filesystem::directory_iterator i(spool_directory, ec), end; i != end; i.increment(ec))
+		if(i->is_regular_file(ec) && ".job" == i->path().extension())
+			job_paths.push_back(i->path());
+
+	// Forget unclaimable jobs that have since been taken away.
+	for(set<std::filesystem::path>::iterator i = unclaimable_job_paths.begin(); i != unclaimable_job_paths.end();)
+	{
+		if(job_paths.end() == find(job_paths.begin(), job_paths.end(), *i))
+			i = unclaimable_job_paths.erase(i);
+		else
+			i++;
+	}
+
+	// Oldest name first, so that jobs named by timestamp or sequence number run in order.
+	sort(job_paths.begin(), job_paths.end());
+
+	for(size_t i = 0; i < job_paths.size(); i++)
+	{
+		if(unclaimable_job_paths.end() == unclaimable_job_paths.find(job_paths[i]))
+		{
+			job_path = job_paths[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool job_server::run_job(const std::filesystem::path &job_path)
+{
+	std::filesystem::path running_path = job_path;
+	running_path.replace_extension(".running");
+
+	std::error_code ec;
+
+	// Claim the job.
+	std::filesystem::rename(job_path, running_path, ec);
+
+	if(ec)
+	{
+		const string claim_error = ec.message();
+
+		// If the job is still there (say, the spool directory is not writable for it), move it
+		// out of the way to <job>.failed, or failing that, skip it from now on.
+		if(true == std::filesystem::exists(job_path, ec))
+		{
+			cout << "Could not claim job " << job_path.stem().string() << ": " << claim_error << endl;
+
+			std::filesystem::path failed_path = job_path;
+			failed_path.replace_extension(".failed");
+			std::filesystem::rename(job_path, failed_path, ec);
+
+			if(ec)
+				unclaimable_job_paths.insert(job_path);
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+		return false;
+	}
+
+	cout << "\nStarting job " << job_path.stem().string() << endl;
+
+	ifstream job_file(running_path.string().c_str());
+
+	string config_file_name, output_file_name, options_line;
+	getline(job_file, config_file_name);
+	getline(job_file, output_file_name);
+	getline(job_file, options_line);
+	job_file.close();
+
+	config_file_name = trim_whitespace_string(config_file_name);
+	output_file_name = trim_whitespace_string(output_file_name);
+
+	// Options only last for one job, and use the same parser as the command line.
+	vector<string> tokens = stl_str_tok(" ", options_line);
+	vector<string> args;
+
+	for(size_t i = 0; i < tokens.size(); i++)
+	{
+		string token = trim_whitespace_string(tokens[i]);
+
+		if("" != token)
+			args.push_back(token);
+	}
+
+	quaternion_julia_set_run_options options;
+	string bad_option;
+
+	for(size_t i = 0; i < args.size(); i++)
+	{
+		if(false == options.parse_option(args, i))
+		{
+			bad_option = args[i];
+			break;
+		}
+	}
+
+	bool ok = false;
+	bool generated = false;
+	string message;
+
+	if("" == config_file_name || "" == output_file_name)
+	{
+		message = "Job file must hold a configuration file name and an output file name.";
+	}
+	else if("" != bad_option)
+	{
+		message = "Unknown or incomplete job option: ";
+		message += bad_option;
+	}
+	else if(false == qjs.load_configuration_from_file(config_file_name.c_str()))
+	{
+		message = "Error reading configuration file ";
+		message += config_file_name;
+	}
+	else
+	{
+		qjs.set_run_options(options);
+
+		const size_t estimated_bytes = qjs.get_estimated_grid_bytes() + qjs.get_estimated_mesh_bytes();
+
+		if(0 != memory_budget_bytes && estimated_bytes > memory_budget_bytes)
+		{
+			ostringstream oss;
+			oss << "Job needs about " << estimated_bytes / 1048576 << " MB for its voxel grids and mesh, which is over the budget of " << memory_budget_bytes / 1048576 << " MB.";
+			message = oss.str();
+		}
+		else
+		{
+			write_status(job_path, "running", "", false);
+			generated = true;
+
+			current_job_path = job_path;
+			current_cancel_path = job_path;
+			current_cancel_path.replace_extension(".cancel");
+			last_progress_stage = "";
+			last_progress_time = std::chrono::steady_clock::now();
+			qjs.set_progress_callback(report_progress, this);
+
+			try
+			{
+				ok = qjs.generate_and_write_isosurface_to_binary_stl_file(output_file_name.c_str());
+				message = qjs.get_status_string();
+			}
+			catch(exception &e)
+			{
+				if(typeid(e) == typeid(bad_alloc))
+					message = "Not enough RAM available.";
+				else
+					message = e.what();
+			}
+
+			qjs.set_progress_callback(0, 0);
+			std::filesystem::remove(current_cancel_path, ec);
+		}
+	}
+
+	jobs_run++;
+
+	write_status(job_path, ok ? "done" : "failed", message, generated);
+
+	std::filesystem::path finished_path = job_path;
+	finished_path.replace_extension(ok ? ".done" : ".failed");
+	std::filesystem::rename(running_path, finished_path, ec);
+
+	cout << "Finished job " << job_path.stem().string() << ": " << (ok ? "done" : "failed") << endl;
+
+	return ok;
+}
+
+void job_server::write_status(const std::filesystem::path &job_path, const string &state, const string &message, const bool include_timings, const string &progress)
+{
+	std::filesystem::path status_path = job_path;
+	status_path.replace_extension(".status");
+
+	// Write to a temporary file and rename it into place, so that readers never see a partial status.
+	std::filesystem::path temp_path = status_path;
+	temp_path += ".tmp";
+
+	ofstream out(temp_path.string().c_str());
+
+	if(out.fail())
+		return;
+
+	out << "state: " << state << endl;
+
+	if("" != message)
+		out << "message: " << message << endl;
+
+	if("" != progress)
+		out << "progress: " << progress << endl;
+
+	if(true == include_timings)
+	{
+		const vector<pair<string, double> > &timings = qjs.get_stage_timings();
+
+		for(size_t i = 0; i < timings.size(); i++)
+			out << "stage: " << timings[i].first << ", " << timings[i].second << " seconds" << endl;
+	}
+
+	out.close();
+
+	std::error_code ec;
+	std::filesystem::rename(temp_path, status_path, ec);
+}
@@ -0,0 +1,70 @@
+// Source code by Shawn Halayka
+// Source code is in the public domain
+
+#ifndef JOB_SERVER_H
+#define JOB_SERVER_H
+
+
+#include "quaternion_julia_set.h"
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <set>
+using std::set;
+
+#include <filesystem>
+#include <chrono>
+
+
+// Runs isosurface jobs dropped into a spool directory, so that a render farm can
+// pay for process start-up and OpenGL initialization once rather than once per job.
+//
+// A job is a text file named <job>.job holding the configuration file name on the first line,
+// the output file name on the second line, and optionally any of -stream, -mmap, -periodicity,
+// -progressive, -verify, -watertight, -surfacenets and -timebudget <seconds> on the third line,
+// as on the command line. A job with an unknown option fails. While it runs, the job file is renamed
+// to <job>.running, and afterwards to <job>.done or <job>.failed. A job file that can not be renamed
+// is moved to <job>.failed if possible, and otherwise skipped. Its state, current stage and progress,
+// and per-stage timings are kept up to date in <job>.status, which can be read at any time.
+// Creating a file named stop in the spool directory shuts the server down once the current job
+// is finished, and creating <job>.cancel stops that job at its next slab.
+//
+// Jobs run one at a time, each using all cores, since they share the one OpenGL context.
+// A job whose voxel grids and mesh would need more than the memory budget is refused.
+// Each job allocates its own grids and mesh; nothing is kept between jobs.
+class job_server
+{
+public:
+	job_server(quaternion_julia_set &src_qjs, const string &src_spool_directory, const size_t src_memory_budget_bytes = 0);
+
+	bool run(void);
+
+	inline string get_status_string(void) { return status_string; }
+
+protected:
+	bool get_next_job(std::filesystem::path &job_path);
+	bool run_job(const std::filesystem::path &job_path);
+	void write_status(const std::filesystem::path &job_path, const string &state, const string &message, const bool include_timings, const string &progress = "");
+	static bool report_progress(const char *const stage_name, const float fraction, void *user_data);
+
+	quaternion_julia_set &qjs;
+	std::filesystem::path spool_directory;
+	size_t memory_budget_bytes;
+	size_t jobs_run;
+
+	set<std::filesystem::path> unclaimable_job_paths;
+
+	std::filesystem::path current_job_path;
+	std::filesystem::path current_cancel_path;
+	string last_progress_stage;
+	std::chrono::steady_clock::time_point last_progress_time;
+
+	string status_string;
+};
+
+
+#endif
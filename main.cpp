@@ -3,6 +3,7 @@
 
 
 #include "quaternion_julia_set.h"
+#include "job_server.h"
 
 
 #include <iostream>
@@ -19,7 +20,7 @@ using std::bad_alloc;
 
 
 
-bool parse_args(int argc, char **argv, bool &force_cpu);
+bool parse_args(int argc, char **argv, bool &force_cpu, string &shader_cache_directory, quaternion_julia_set_run_options &options);
 
 // To do: consider using double-precision, and outputting to OBJ or Collada with large setprecision().
 int main(int argc, char **argv)
@@ -27,18 +28,92 @@ int main(int argc, char **argv)
 	cout << "GPU-accelerated quaternion Julia set isosurface extractor v" << QJS_VERSION_NUMBER << endl;
 
 
+	// Decode a quantized mesh file back to binary STL.
+	if(4 == argc && "-decode" == lower_string(argv[1]))
+	{
+		indexed_mesh m;
+
+		if(false == m.load_from_quantized_mesh_file(argv[2]))
+		{
+			cout << "Error reading quantized mesh file " << argv[2] << ": " << m.get_status_string() << endl;
+			return 1;
+		}
+
+		cout << "Triangles: " << m.get_triangle_count() << endl;
+		cout << "Vertices:  " << m.get_vertex_count() << endl;
+
+		if(false == m.save_to_binary_stereo_lithography_file(argv[3]))
+		{
+			cout << "Error writing binary Stereo Lithography file " << argv[3] << endl;
+			return 2;
+		}
+
+		return 0;
+	}
+
+	// Run jobs from a spool directory until told to stop.
+	if(3 <= argc && "-serve" == lower_string(argv[1]))
+	{
+		bool force_cpu = false;
+		size_t memory_budget_mb = 0;
+		string shader_cache_directory;
+
+		for(int i = 3; i < argc; i++)
+		{
+			string arg = lower_string(argv[i]);
+
+			if(arg == "-cpu")
+				force_cpu = true;
+			else if(arg == "-budget" && i + 1 < argc && is_unsigned_int(argv[i + 1]))
+				istringstream(argv[++i]) >> memory_budget_mb;
+			else if(arg == "-cache" && i + 1 < argc)
+				shader_cache_directory = argv[++i];
+		}
+
+		quaternion_julia_set qjs(force_cpu);
+		qjs.set_shader_cache_directory(shader_cache_directory);
+		cout << qjs.get_status_string() << '\n' << endl;
+
+		job_server server(qjs, argv[2], memory_budget_mb*1048576);
+
+		if(false == server.run())
+		{
+			cout << "Error: " << server.get_status_string() << endl;
+			return 2;
+		}
+
+		return 0;
+	}
+
 	// Get command-line arguments.
 	bool force_cpu = false;
+	string shader_cache_directory;
+	quaternion_julia_set_run_options options;
 
-	if(false == parse_args(argc, argv, force_cpu))
+	if(false == parse_args(argc, argv, force_cpu, shader_cache_directory, options))
 	{
-		cout << "Example usage: " << argv[0] << " config.txt fractal.stl [-cpu]" << endl;
+		cout << "Example usage: " << argv[0] << " config.txt fractal.stl [-cpu] [-stream] [-mmap] [-periodicity] [-progressive] [-verify] [-watertight | -surfacenets] [-cache directory] [-timebudget seconds]" << endl;
+		cout << "  The output format follows the file extension: .stl (default), .ply, .obj, .glb or .qjm (quantized)" << endl;
+		cout << "To serve jobs from a spool directory: " << argv[0] << " -serve spool_directory [-cpu] [-budget megabytes] [-cache directory]" << endl;
+		cout << "To decode a quantized mesh: " << argv[0] << " -decode fractal.qjm fractal.stl" << endl;
+		cout << "  -cpu     Do not use the GPU" << endl;
+		cout << "  -stream  Write triangles straight to the STL file, skipping mesh welding and validation" << endl;
+		cout << "  -mmap    Keep the voxel grids in memory-mapped scratch files next to the output file, for grids larger than RAM" << endl;
+		cout << "  -periodicity  Stop iterating early once an orbit settles into a cycle" << endl;
+		cout << "  -progressive  Evaluate the set coarse to fine, writing a preview STL after each level" << endl;
+		cout << "  -verify       Read a .qjm file back after writing it, and check it against the mesh" << endl;
+		cout << "  -watertight   Use marching tetrahedra, which always makes a closed, manifold mesh (with about three times the triangles), and skip validation" << endl;
+		cout << "  -surfacenets  Use naive surface nets, which makes better shaped triangles, but not always a manifold mesh" << endl;
+		cout << "  -cache   Keep linked shader programs in the given directory, so that later runs can skip compiling them" << endl;
+		cout << "  -timebudget  Lower the grid resolution or skip vertex refinement as needed to finish in about this many seconds" << endl;
 		return 0;
 	}
 
 
 	// Create quaternion Julia set object / initialize OpenGL.
 	quaternion_julia_set qjs(force_cpu);
+	qjs.set_run_options(options);
+	qjs.set_shader_cache_directory(shader_cache_directory);
 	cout << qjs.get_status_string() << '\n' << endl;
 
 
@@ -108,30 +183,31 @@ int main(int argc, char **argv)
 	return 0;
 }
 
-bool parse_args(int argc, char **argv, bool &force_cpu)
+bool parse_args(int argc, char **argv, bool &force_cpu, string &shader_cache_directory, quaternion_julia_set_run_options &options)
 {
-	// Assume that the arguments are bad until we know otherwise.
-	bool successful_parse = false;
-
-	// Use GPU mode by default.
+	// Use GPU mode and the indexed mesh by default.
 	force_cpu = false;
+	shader_cache_directory = "";
+	options = quaternion_julia_set_run_options();
 
-	if(3 == argc)
-	{
-		// OK -- we've got an input file name and an output file name.
-		successful_parse = true;
-	}
-	else if(4 == argc)
+	// We need at least an input file name and an output file name.
+	if(3 > argc)
+		return false;
+
+	vector<string> args(argv + 3, argv + argc);
+
+	// Any remaining arguments must be valid options.
+	for(size_t i = 0; i < args.size(); i++)
 	{
-		string last_arg = lower_string(argv[3]);
-		
-		// OK -- we've got an input file name, an output file name, and a valid 'force cpu' argument.
-		if(last_arg == "-cpu" || last_arg == "/cpu" || last_arg == "cpu")
-		{
+		string arg = lower_string(args[i]);
+
+		if(arg == "-cpu" || arg == "/cpu" || arg == "cpu")
 			force_cpu = true;
-			successful_parse = true;
-		}
+		else if((arg == "-cache" || arg == "/cache" || arg == "cache") && i + 1 < args.size())
+			shader_cache_directory = args[++i];
+		else if(false == options.parse_option(args, i))
+			return false;
 	}
 
-	return successful_parse;
+	return true;
 }
@@ -1,5 +1,14 @@
 // Modified from Paul Bourke, Polygonising a Scalar Field
 
+#include "marching_cubes.h"
+
+#include <algorithm> // for swap()
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+
 namespace marching_cubes
 {
 	int mc_edge_table[256] = {
@@ -296,4 +305,194 @@ namespace marching_cubes
 		{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}
 	};
 
+	const unsigned char mc_corner_offsets[8][3] = {
+		{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1},
+		{0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}
+	};
+
+	const unsigned char mc_cube_edge_ids[max_edges_per_mt_cell][4] = {
+		{0, 0, 0, 1}, {1, 0, 0, 4}, {0, 0, 1, 1}, {0, 0, 0, 4},
+		{0, 1, 0, 1}, {1, 1, 0, 4}, {0, 1, 1, 1}, {0, 1, 0, 4},
+		{0, 0, 0, 2}, {1, 0, 0, 2}, {1, 0, 1, 2}, {0, 0, 1, 2},
+		{0, 0, 0, 3}, {0, 0, 1, 3}, {0, 0, 0, 5}, {0, 1, 0, 5},
+		{0, 0, 0, 6}, {1, 0, 0, 6}, {0, 0, 0, 7}
+	};
+
+	const unsigned char mt_tetrahedra[6][4] = {
+		{0, 1, 5, 6}, {0, 1, 2, 6}, {0, 4, 5, 6},
+		{0, 4, 7, 6}, {0, 3, 2, 6}, {0, 3, 7, 6}
+	};
+
+	mc_case mc_cases[256];
+	mc_case mt_cases[256];
+
+	// The index of the lowest set bit of a nonzero value.
+	static inline unsigned int count_trailing_zeros(const unsigned int value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return static_cast<unsigned int>(index);
+#else
+		return static_cast<unsigned int>(__builtin_ctz(value));
+#endif
+	}
+
+	// The cell edge between two cube corners of a tetrahedron.
+	static unsigned char get_tetrahedron_edge(const size_t corner0, const size_t corner1)
+	{
+		const unsigned char *o0 = mc_corner_offsets[corner0];
+		const unsigned char *o1 = mc_corner_offsets[corner1];
+
+		// The edges of the tetrahedra only ever run in the + direction, so the low end is the one nearer the origin.
+		if(o0[0] + o0[1] + o0[2] > o1[0] + o1[1] + o1[2])
+			std::swap(o0, o1);
+
+		const unsigned char direction = static_cast<unsigned char>((o1[0] - o0[0]) | ((o1[1] - o0[1]) << 1) | ((o1[2] - o0[2]) << 2));
+
+		for(unsigned char edge = 0; edge < max_edges_per_mt_cell; edge++)
+			if( o0[0] == mc_cube_edge_ids[edge][0] && o0[1] == mc_cube_edge_ids[edge][1] &&
+				o0[2] == mc_cube_edge_ids[edge][2] && direction == mc_cube_edge_ids[edge][3] )
+				return edge;
+
+		return 0;
+	}
+
+	// Adds the triangle across the edges (in0, out0), (in1, out1), (in2, out2) of a tetrahedron,
+	// wound so that it faces from the corners in the set to the corners outside of it, as the Paul Bourke tables do.
+	static void add_tetrahedron_triangle(const size_t in0, const size_t out0, const size_t in1, const size_t out1, const size_t in2, const size_t out2, unsigned char (*const triangle_edges)[3], size_t &triangle_count)
+	{
+		const size_t ends[3][2] = { {in0, out0}, {in1, out1}, {in2, out2} };
+		float midpoints[3][3];
+
+		for(size_t i = 0; i < 3; i++)
+			for(size_t j = 0; j < 3; j++)
+				midpoints[i][j] = 0.5f*(mc_corner_offsets[ends[i][0]][j] + mc_corner_offsets[ends[i][1]][j]);
+
+		const float a[3] = { midpoints[1][0] - midpoints[0][0], midpoints[1][1] - midpoints[0][1], midpoints[1][2] - midpoints[0][2] };
+		const float b[3] = { midpoints[2][0] - midpoints[0][0], midpoints[2][1] - midpoints[0][1], midpoints[2][2] - midpoints[0][2] };
+		const float normal[3] = { a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0] };
+
+		float outward = 0;
+
+		for(size_t j = 0; j < 3; j++)
+			outward += normal[j]*(static_cast<float>(mc_corner_offsets[out0][j]) - mc_corner_offsets[in0][j]);
+
+		triangle_edges[triangle_count][0] = get_tetrahedron_edge(in0, out0);
+		triangle_edges[triangle_count][1] = get_tetrahedron_edge(in1, out1);
+		triangle_edges[triangle_count][2] = get_tetrahedron_edge(in2, out2);
+
+		if(outward < 0)
+			std::swap(triangle_edges[triangle_count][1], triangle_edges[triangle_count][2]);
+
+		triangle_count++;
+	}
+
+	// Repacks the tables into mc_cases, and builds mt_cases, once, before main() runs.
+	class mc_case_builder
+	{
+	public:
+		mc_case_builder(void)
+		{
+			build_mc_cases();
+			build_mt_cases();
+		}
+
+	protected:
+		void build_mc_cases(void)
+		{
+			for(size_t i = 0; i < 256; i++)
+			{
+				mc_case &c = mc_cases[i];
+				unsigned char edge_positions[12] = { 0 };
+
+				c.edge_count = 0;
+
+				// Visit only the set bits, lowest first.
+				for(unsigned int bits = static_cast<unsigned int>(mc_edge_table[i]); 0 != bits; bits &= bits - 1)
+				{
+					const unsigned int edge = count_trailing_zeros(bits);
+
+					edge_positions[edge] = c.edge_count;
+					c.edges[c.edge_count++] = static_cast<unsigned char>(edge);
+				}
+
+				c.triangle_count = 0;
+
+				for(size_t j = 0; -1 != mc_tri_table[i][j]; j += 3)
+				{
+					c.triangles[j + 0] = edge_positions[mc_tri_table[i][j + 0]];
+					c.triangles[j + 1] = edge_positions[mc_tri_table[i][j + 1]];
+					c.triangles[j + 2] = edge_positions[mc_tri_table[i][j + 2]];
+					c.triangle_count++;
+				}
+			}
+		}
+
+		void build_mt_cases(void)
+		{
+			for(size_t i = 0; i < 256; i++)
+			{
+				unsigned char triangle_edges[max_triangles_per_mt_cell][3];
+				size_t triangle_count = 0;
+
+				for(size_t t = 0; t < 6; t++)
+				{
+					// Split the tetrahedron's corners into those in the set (bit set) and those outside of it.
+					size_t in[4], out[4];
+					size_t in_count = 0, out_count = 0;
+
+					for(size_t j = 0; j < 4; j++)
+					{
+						const size_t corner = mt_tetrahedra[t][j];
+
+						if(i & (1 << corner))
+							in[in_count++] = corner;
+						else
+							out[out_count++] = corner;
+					}
+
+					// One corner apart from the other three makes a triangle; two and two make a quad.
+					if(1 == in_count)
+						add_tetrahedron_triangle(in[0], out[0], in[0], out[1], in[0], out[2], triangle_edges, triangle_count);
+					else if(3 == in_count)
+						add_tetrahedron_triangle(in[0], out[0], in[1], out[0], in[2], out[0], triangle_edges, triangle_count);
+					else if(2 == in_count)
+					{
+						add_tetrahedron_triangle(in[0], out[0], in[0], out[1], in[1], out[1], triangle_edges, triangle_count);
+						add_tetrahedron_triangle(in[0], out[0], in[1], out[1], in[1], out[0], triangle_edges, triangle_count);
+					}
+				}
+
+				// List the edges used in edge order, and point the triangles into that list.
+				unsigned int edge_mask = 0;
+
+				for(size_t j = 0; j < triangle_count; j++)
+					for(size_t k = 0; k < 3; k++)
+						edge_mask |= (1u << triangle_edges[j][k]);
+
+				mc_case &c = mt_cases[i];
+				unsigned char edge_positions[max_edges_per_mt_cell] = { 0 };
+
+				c.edge_count = 0;
+
+				for(unsigned int bits = edge_mask; 0 != bits; bits &= bits - 1)
+				{
+					const unsigned int edge = count_trailing_zeros(bits);
+
+					edge_positions[edge] = c.edge_count;
+					c.edges[c.edge_count++] = static_cast<unsigned char>(edge);
+				}
+
+				c.triangle_count = static_cast<unsigned char>(triangle_count);
+
+				for(size_t j = 0; j < triangle_count; j++)
+					for(size_t k = 0; k < 3; k++)
+						c.triangles[j*3 + k] = edge_positions[triangle_edges[j][k]];
+			}
+		}
+	};
+
+	static mc_case_builder case_builder;
+
 };
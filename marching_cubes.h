@@ -10,18 +10,60 @@
 
 namespace marching_cubes
 {
-	class mc_grid_cube
+	// An edge of the grid, by the lattice index of the grid point at its low end and the direction
+	// that it runs in (bit 0 for +x, bit 1 for +y, bit 2 for +z). Cube edges have one bit set;
+	// the face and body diagonals that marching tetrahedra adds have two or three.
+	// Every cube that shares an edge names it the same way.
+	class mc_edge_id
 	{
 	public:
-		vertex_3 vertex[8];
-		bool value[8];
+		unsigned int x, y, z;
+		unsigned char direction;
+
+		inline bool operator==(const mc_edge_id &right) const
+		{
+			return x == right.x && y == right.y && z == right.z && direction == right.direction;
+		}
 	};
 
-	// Marching Cubes will make a maximum of 5 triangles per cell.
+	// Marching Cubes will make a maximum of 5 triangles per cell, using at most 12 edges.
 	const size_t max_triangles_per_mc_cell = 5;
+	const size_t max_edges_per_mc_cell = 12;
+
+	// Marching tetrahedra splits each cell into 6 tetrahedra of up to 2 triangles each,
+	// using the 12 cube edges, 6 face diagonals and 1 body diagonal.
+	const size_t max_triangles_per_mt_cell = 12;
+	const size_t max_edges_per_mt_cell = 19;
 
 	extern int mc_edge_table[256];
 	extern int mc_tri_table[256][16];
+
+	// One case of a cell: the edges with a vertex on them in edge order,
+	// and the triangles as indices into that list of edges instead of as edge numbers.
+	class mc_case
+	{
+	public:
+		unsigned char edge_count;
+		unsigned char triangle_count;
+		unsigned char edges[max_edges_per_mt_cell];
+		unsigned char triangles[max_triangles_per_mt_cell*3];
+	};
+
+	// Both filled in when the program starts: mc_cases from mc_edge_table and mc_tri_table,
+	// and mt_cases by splitting the cell into the tetrahedra of mt_tetrahedra.
+	extern mc_case mc_cases[256];
+	extern mc_case mt_cases[256];
+
+	// Cube corner offsets, and each cell edge as the offset of its low end and its direction.
+	// The first 12 edges are the cube edges, in the order of the tables above; the rest are the diagonals.
+	extern const unsigned char mc_corner_offsets[8][3];
+	extern const unsigned char mc_cube_edge_ids[max_edges_per_mt_cell][4];
+
+	// The six tetrahedra that a cell is split into, as cube corners. They all share the body diagonal
+	// from corner 0 to corner 6, and every cell is split the same way, so the diagonals
+	// of neighbouring cells line up across their shared faces.
+	extern const unsigned char mt_tetrahedra[6][4];
+
 };
 
 
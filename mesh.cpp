@@ -3,7 +3,9 @@
 
 bool indexed_mesh::operator==(const indexed_mesh &right)
 {
-	if(triangles == right.triangles &&	vertices == right.vertices && vertex_to_triangle_indices == right.vertex_to_triangle_indices &&	vertex_to_vertex_indices == right.vertex_to_vertex_indices)
+	if(triangles == right.triangles &&	vertices == right.vertices &&
+		vertex_to_triangle_offsets == right.vertex_to_triangle_offsets && vertex_to_triangle_indices == right.vertex_to_triangle_indices &&
+		vertex_to_vertex_offsets == right.vertex_to_vertex_offsets && vertex_to_vertex_indices == right.vertex_to_vertex_indices)
 		return true;
 
 	return false;
@@ -56,54 +58,114 @@ void indexed_mesh::insert_triangle(const triangle &src_tri)
 
 			// Assign vertex index to triangle
 			triangles[tri_index].vertex_indices[j] = v.index;
-
-			// Add triangle index to vertex
-			vector<size_t> tri_indices;
-			tri_indices.push_back(tri_index);
-			vertex_to_triangle_indices.push_back(tri_indices);
 		}
 		else
 		{
 			// Assign existing vertex index to triangle
 			triangles[tri_index].vertex_indices[j] = find_iter->index;
-
-			// Add triangle index to vertex
-			vertex_to_triangle_indices[find_iter->index].push_back(tri_index);
 		}
 	} // End of: for(short unsigned int j = 0; j < 3; j++) ...
 }
 
 void indexed_mesh::finalize_triangle_insertion(void)
 {
+	vertex_set.clear();
+	statistics_cached = false;
+	status_string = "OK";
+
 	if(0 == triangles.size())
 	{
 		finalized = true;
 		return;
 	}
 
-	vertex_to_vertex_indices.resize(vertices.size());
+	// The adjacency lists hold 32-bit vertex and triangle indices, so larger meshes can not be finalized.
+	if(vertices.size() > max_adjacency_index || triangles.size() > max_adjacency_index)
+	{
+		status_string = "The mesh has more than 2^32 vertices or triangles, which is too many to index.";
+		return;
+	}
+
+	const long long num_vertices = static_cast<long long>(vertices.size());
+	const long long num_triangles = static_cast<long long>(triangles.size());
+
+	// Build the vertex-to-triangle adjacency with a counting sort.
+	// First pass: count the triangles that reference each vertex.
+	vertex_to_triangle_offsets.assign(vertices.size() + 1, 0);
 
-	for(size_t i = 0; i < vertex_to_triangle_indices.size(); i++)
+	#pragma omp parallel for schedule(static)
+	for(long long i = 0; i < num_triangles; i++)
 	{
-		// Use a temporary set to avoid duplicates.
-		set<size_t> vertex_to_vertex_indices_set;
+		for(size_t j = 0; j < 3; j++)
+		{
+			#pragma omp atomic
+			vertex_to_triangle_offsets[triangles[i].vertex_indices[j] + 1]++;
+		}
+	}
+
+	for(size_t i = 0; i < vertices.size(); i++)
+		vertex_to_triangle_offsets[i + 1] += vertex_to_triangle_offsets[i];
 
-		for(size_t j = 0; j < vertex_to_triangle_indices[i].size(); j++)
+	// Second pass: scatter the triangle indices into their vertices' slots.
+	vertex_to_triangle_indices.resize(vertex_to_triangle_offsets[vertices.size()]);
+	vector<size_t> fill_positions(vertex_to_triangle_offsets.begin(), vertex_to_triangle_offsets.end() - 1);
+
+	#pragma omp parallel for schedule(static)
+	for(long long i = 0; i < num_triangles; i++)
+	{
+		for(size_t j = 0; j < 3; j++)
 		{
-			size_t tri_index = vertex_to_triangle_indices[i][j];
+			size_t slot;
 
-			for(size_t k = 0; k < 3; k++)
-				if(i != triangles[tri_index].vertex_indices[k]) // Don't add current vertex index to its own adjacency list.
-					vertex_to_vertex_indices_set.insert(triangles[tri_index].vertex_indices[k]);
+			#pragma omp atomic capture
+			slot = fill_positions[triangles[i].vertex_indices[j]]++;
+
+			vertex_to_triangle_indices[slot] = static_cast<unsigned int>(i);
 		}
+	}
+
+	// Threads may have scattered in any order, so sort each list to keep the result deterministic.
+	#pragma omp parallel for schedule(dynamic, 4096)
+	for(long long i = 0; i < num_vertices; i++)
+		sort(vertex_to_triangle_indices.begin() + vertex_to_triangle_offsets[i], vertex_to_triangle_indices.begin() + vertex_to_triangle_offsets[i + 1]);
+
+	// Build the vertex-to-vertex adjacency.
+	// First pass: count the unique neighbours of each vertex.
+	vertex_to_vertex_offsets.assign(vertices.size() + 1, 0);
 
-		// Copy to final vector.
-		for(set<size_t>::const_iterator ci = vertex_to_vertex_indices_set.begin(); ci != vertex_to_vertex_indices_set.end(); ci++)
-			vertex_to_vertex_indices[i].push_back(*ci);
+	#pragma omp parallel
+	{
+		vector<unsigned int> neighbours;
+
+		#pragma omp for schedule(dynamic, 4096)
+		for(long long i = 0; i < num_vertices; i++)
+		{
+			get_vertex_neighbours(static_cast<size_t>(i), neighbours);
+			vertex_to_vertex_offsets[i + 1] = neighbours.size();
+		}
+	}
+
+	for(size_t i = 0; i < vertices.size(); i++)
+		vertex_to_vertex_offsets[i + 1] += vertex_to_vertex_offsets[i];
+
+	// Second pass: write the neighbours into their final slots.
+	vertex_to_vertex_indices.resize(vertex_to_vertex_offsets[vertices.size()]);
+
+	#pragma omp parallel
+	{
+		vector<unsigned int> neighbours;
+
+		#pragma omp for schedule(dynamic, 4096)
+		for(long long i = 0; i < num_vertices; i++)
+		{
+			get_vertex_neighbours(static_cast<size_t>(i), neighbours);
+
+			if(0 < neighbours.size())
+				memcpy(&vertex_to_vertex_indices[vertex_to_vertex_offsets[i]], &neighbours[0], neighbours.size()*sizeof(unsigned int));
+		}
 	}
 
 	finalized = true;
-	vertex_set.clear();
 }
 
 bool indexed_mesh::save_to_binary_stereo_lithography_file(const char *const file_name, const size_t buffer_width)
@@ -111,141 +173,706 @@ bool indexed_mesh::save_to_binary_stereo_lithography_file(const char *const file
 	if(false == finalized)
 		return false;
 
-	if(0 == triangles.size())
+	if(0 == triangles.size() || 0 == buffer_width)
 		return false;
 
+	const unsigned int num_triangles = triangles.size(); // Must be 4-byte unsigned int.
+
+#ifdef QJS_HAVE_MMAP
+	if(true == save_to_binary_stereo_lithography_mapping(file_name, buffer_width))
+		return true;
+
+	// Fall back to writing through a buffer, for example when the file system can not reserve the space.
+#endif
+
 	// Write to file.
 	ofstream out(file_name, ios_base::binary);
 
 	if(out.fail())
 		return false;
 
-	const size_t header_size = 80;
-	vector<char> buffer(header_size, 0);
-	const unsigned int num_triangles = triangles.size(); // Must be 4-byte unsigned int.
-	vertex_3 normal;
+	vector<char> buffer(stl_header_size, 0);
 
 	// Write blank header.
-	out.write(reinterpret_cast<const char *>(&(buffer[0])), header_size);
+	out.write(reinterpret_cast<const char *>(&(buffer[0])), stl_header_size);
 
 	// Write number of triangles.
 	out.write(reinterpret_cast<const char *>(&num_triangles), sizeof(unsigned int));
 
-	// Enough bytes for twelve 4-byte floats plus one 2-byte integer, per triangle.
-	const size_t per_triangle_data_size = (12*sizeof(float) + sizeof(short unsigned int));
-	const size_t buffer_size = per_triangle_data_size * buffer_width;
-	buffer.resize(buffer_size, 0);
+	buffer.resize(stl_per_triangle_data_size * buffer_width, 0);
+
+	// Format one large buffer's worth of triangles in parallel, then write it out in a single call.
+	for(size_t i = 0; i < triangles.size(); i += buffer_width)
+	{
+		size_t buffer_count = buffer_width;
 
-	// Use a pointer to assist with the copying.
-	// Should probably use std::copy() instead, but memcpy() does the trick, so whatever...
-	char *cp = &buffer[0];
-	size_t buffer_count = 0;
+		// The last buffer is partially filled whenever triangles.size() % buffer_width != 0.
+		if(i + buffer_count > triangles.size())
+			buffer_count = triangles.size() - i;
 
-	cout << "Writing " << per_triangle_data_size*triangles.size() / 1048576 << " MB of data to disk" << endl;
+		write_stereo_lithography_records(&buffer[0], i, buffer_count);
 
-	for(size_t i = 0; i < triangles.size(); i++)
+		out.write(reinterpret_cast<const char *>(&buffer[0]), stl_per_triangle_data_size*buffer_count);
+
+		if(out.fail())
+			return false;
+	}
+
+	out.close();
+
+	return true;
+}
+
+#ifdef QJS_HAVE_MMAP
+bool indexed_mesh::save_to_binary_stereo_lithography_mapping(const char *const file_name, const size_t buffer_width)
+{
+	const unsigned int num_triangles = triangles.size(); // Must be 4-byte unsigned int.
+	const size_t file_size = stl_header_size + sizeof(unsigned int) + stl_per_triangle_data_size*triangles.size();
+
+	// Map the file, so that each thread formats its triangles straight into the page cache.
+	int fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if(-1 == fd)
+		return false;
+
+	// Reserve the blocks up front. A sparse file could run out of disk space part way through,
+	// and a store to an unbacked page raises SIGBUS rather than returning an error.
+	if(0 != posix_fallocate(fd, 0, file_size))
 	{
-		vertex_3 v0 = vertices[triangles[i].vertex_indices[1]] - vertices[triangles[i].vertex_indices[0]];
-		vertex_3 v1 = vertices[triangles[i].vertex_indices[2]] - vertices[triangles[i].vertex_indices[0]];
-		normal = v0.cross(v1);
-		normal.normalize();
+		close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(0, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if(MAP_FAILED == mapping)
+	{
+		close(fd);
+		return false;
+	}
+
+	char *cp = static_cast<char *>(mapping);
+
+	// The header is already zero-filled by posix_fallocate().
+	memcpy(cp + stl_header_size, &num_triangles, sizeof(unsigned int));
+
+	cp += stl_header_size + sizeof(unsigned int);
+
+	// Format buffer_width triangles at a time, the same as the buffered writer.
+	for(size_t i = 0; i < triangles.size(); i += buffer_width)
+	{
+		size_t buffer_count = buffer_width;
+
+		if(i + buffer_count > triangles.size())
+			buffer_count = triangles.size() - i;
 
-		memcpy(cp, &normal.x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &normal.y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &normal.z, sizeof(float)); cp += sizeof(float);
+		write_stereo_lithography_records(cp + stl_per_triangle_data_size*i, i, buffer_count);
+	}
+
+	// Write errors only show up once the pages are flushed.
+	bool write_ok = (0 == msync(mapping, file_size, MS_SYNC));
 
-		memcpy(cp, &vertices[triangles[i].vertex_indices[0]].x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[0]].y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[0]].z, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[1]].x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[1]].y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[1]].z, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[2]].x, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[2]].y, sizeof(float)); cp += sizeof(float);
-		memcpy(cp, &vertices[triangles[i].vertex_indices[2]].z, sizeof(float)); cp += sizeof(float);
+	if(0 != munmap(mapping, file_size))
+		write_ok = false;
 
-		cp += sizeof(short unsigned int);
+	if(0 != close(fd))
+		write_ok = false;
+
+	return write_ok;
+}
+#endif
 
-		buffer_count++;
+bool indexed_mesh::save_to_binary_polygon_file(const char *const file_name, const size_t buffer_width)
+{
+	if(false == finalized)
+		return false;
 
-		// If buffer is full, write triangles in buffer to disk.
-		if(buffer_count == buffer_width)
+	// PLY list indices are 32-bit.
+	if(0 == triangles.size() || vertices.size() > 0xffffffff)
+		return false;
+
+	ofstream out(file_name, ios_base::binary);
+
+	if(out.fail())
+		return false;
+
+	ostringstream header;
+	header << "ply\n";
+	header << "format binary_little_endian 1.0\n";
+	header << "element vertex " << vertices.size() << '\n';
+	header << "property float x\n";
+	header << "property float y\n";
+	header << "property float z\n";
+	header << "element face " << triangles.size() << '\n';
+	header << "property list uchar uint vertex_indices\n";
+	header << "end_header\n";
+
+	const string header_string = header.str();
+	out.write(header_string.c_str(), header_string.size());
+
+	// The vertex array is already laid out as three packed floats per vertex.
+	out.write(reinterpret_cast<const char *>(&vertices[0]), vertices.size()*sizeof(vertex_3));
+
+	// One count byte plus three 4-byte indices, per face.
+	const size_t per_face_data_size = sizeof(unsigned char) + 3*sizeof(unsigned int);
+	vector<char> buffer(per_face_data_size * buffer_width, 0);
+
+	for(size_t i = 0; i < triangles.size(); i += buffer_width)
+	{
+		size_t buffer_count = buffer_width;
+
+		if(i + buffer_count > triangles.size())
+			buffer_count = triangles.size() - i;
+
+		const long long count = static_cast<long long>(buffer_count);
+
+		#pragma omp parallel for schedule(static)
+		for(long long j = 0; j < count; j++)
 		{
-			out.write(reinterpret_cast<const char *>(&buffer[0]), buffer_size);
+			const indexed_triangle &t = triangles[i + j];
+			const unsigned int indices[3] = { static_cast<unsigned int>(t.vertex_indices[0]), static_cast<unsigned int>(t.vertex_indices[1]), static_cast<unsigned int>(t.vertex_indices[2]) };
+			char *cp = &buffer[per_face_data_size*j];
+
+			*cp = 3;
+			memcpy(cp + 1, indices, sizeof(indices));
+		}
+
+		out.write(&buffer[0], per_face_data_size*buffer_count);
+
+		if(out.fail())
+			return false;
+	}
+
+	out.close();
+
+	return true;
+}
+
+// Appends the shortest text that reads back as exactly the same float.
+static inline char *write_float_text(char *cp, char *const end, const float f)
+{
+#if defined(__cpp_lib_to_chars)
+	return std::to_chars(cp, end, f).ptr;
+#else
+	int length = snprintf(cp, end - cp, "%.9g", f);
+	return cp + length;
+#endif
+}
+
+static inline char *write_index_text(char *cp, char *const end, const size_t index)
+{
+#if defined(__cpp_lib_to_chars)
+	return std::to_chars(cp, end, index).ptr;
+#else
+	int length = snprintf(cp, end - cp, "%llu", static_cast<unsigned long long>(index));
+	return cp + length;
+#endif
+}
+
+bool indexed_mesh::save_to_wavefront_obj_file(const char *const file_name, const size_t block_width)
+{
+	if(false == finalized)
+		return false;
+
+	if(0 == triangles.size())
+		return false;
+
+	ofstream out(file_name, ios_base::binary);
+
+	if(out.fail())
+		return false;
+
+	// Lines are formatted in blocks of block_width elements. Each thread fills its own blocks,
+	// and the blocks are written out in order once a whole batch is done.
+	#ifdef _OPENMP
+		const size_t blocks_per_batch = 4*omp_get_max_threads();
+	#else
+		const size_t blocks_per_batch = 1;
+	#endif
+
+	// Worst case: a letter, three numbers with up to 24 characters each, separators and a newline.
+	const size_t max_line_size = 80;
+	vector< vector<char> > blocks(blocks_per_batch, vector<char>(max_line_size*block_width));
+	vector<size_t> block_sizes(blocks_per_batch, 0);
+
+	for(size_t pass = 0; pass < 2; pass++)
+	{
+		const size_t element_count = (0 == pass) ? vertices.size() : triangles.size();
+
+		for(size_t batch_start = 0; batch_start < element_count; batch_start += blocks_per_batch*block_width)
+		{
+			#pragma omp parallel for schedule(dynamic, 1)
+			for(long long b = 0; b < static_cast<long long>(blocks_per_batch); b++)
+			{
+				const size_t first = batch_start + b*block_width;
+				size_t last = first + block_width;
+
+				if(last > element_count)
+					last = element_count;
+
+				char *const begin = &blocks[b][0];
+				char *const end = begin + blocks[b].size();
+				char *cp = begin;
+
+				for(size_t i = first; i < last; i++)
+				{
+					if(0 == pass)
+					{
+						*cp++ = 'v'; *cp++ = ' ';
+						cp = write_float_text(cp, end, vertices[i].x); *cp++ = ' ';
+						cp = write_float_text(cp, end, vertices[i].y); *cp++ = ' ';
+						cp = write_float_text(cp, end, vertices[i].z); *cp++ = '\n';
+					}
+					else
+					{
+						// OBJ indices are 1-based.
+						*cp++ = 'f'; *cp++ = ' ';
+						cp = write_index_text(cp, end, triangles[i].vertex_indices[0] + 1); *cp++ = ' ';
+						cp = write_index_text(cp, end, triangles[i].vertex_indices[1] + 1); *cp++ = ' ';
+						cp = write_index_text(cp, end, triangles[i].vertex_indices[2] + 1); *cp++ = '\n';
+					}
+				}
+
+				block_sizes[b] = (first < last) ? cp - begin : 0;
+			}
+
+			for(size_t b = 0; b < blocks_per_batch; b++)
+				if(0 < block_sizes[b])
+					out.write(&blocks[b][0], block_sizes[b]);
 
 			if(out.fail())
 				return false;
+		}
+	}
 
-			buffer_count = 0;
-			cp = &buffer[0];
+	out.close();
+
+	return true;
+}
+
+bool indexed_mesh::save_to_gltf_binary_file(const char *const file_name)
+{
+	if(false == finalized)
+		return false;
+
+	if(0 == triangles.size() || vertices.size() > 0xffffffff)
+		return false;
+
+	mesh_statistics stats;
+	get_statistics(stats);
+
+	// Use 16-bit indices when the vertex count allows, otherwise 32-bit.
+	const bool short_indices = vertices.size() <= 0xffff;
+	const size_t index_size = short_indices ? sizeof(short unsigned int) : sizeof(unsigned int);
+	const size_t positions_byte_length = vertices.size()*sizeof(vertex_3);
+	const size_t indices_byte_length = triangles.size()*3*index_size;
+	const size_t indices_padded_byte_length = (indices_byte_length + 3) & ~static_cast<size_t>(3);
+	const size_t bin_byte_length = positions_byte_length + indices_padded_byte_length;
+
+	ostringstream json;
+	json.precision(9);
+	json << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],";
+	json << "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0},\"indices\":1}]}],";
+	json << "\"accessors\":[";
+	json << "{\"bufferView\":0,\"componentType\":5126,\"count\":" << vertices.size() << ",\"type\":\"VEC3\",";
+	json << "\"min\":[" << stats.min_corner.x << ',' << stats.min_corner.y << ',' << stats.min_corner.z << "],";
+	json << "\"max\":[" << stats.max_corner.x << ',' << stats.max_corner.y << ',' << stats.max_corner.z << "]},";
+	json << "{\"bufferView\":1,\"componentType\":" << (short_indices ? 5123 : 5125) << ",\"count\":" << triangles.size()*3 << ",\"type\":\"SCALAR\"}],";
+	json << "\"bufferViews\":[";
+	json << "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << positions_byte_length << ",\"target\":34962},";
+	json << "{\"buffer\":0,\"byteOffset\":" << positions_byte_length << ",\"byteLength\":" << indices_byte_length << ",\"target\":34963}],";
+	json << "\"buffers\":[{\"byteLength\":" << bin_byte_length << "}]}";
+
+	// Chunks must be 4-byte aligned; JSON is padded with spaces.
+	string json_string = json.str();
+
+	while(0 != json_string.size() % 4)
+		json_string += ' ';
+
+	// The container sizes are 32-bit: the 12-byte header, then two chunks with 8-byte headers.
+	const size_t total_byte_length = 12 + 8 + json_string.size() + 8 + bin_byte_length;
+
+	if(total_byte_length > 0xffffffff)
+		return false;
+
+	// Convert the indices to their output width in parallel.
+	vector<char> indices(indices_padded_byte_length, 0);
+	const long long num_triangles = static_cast<long long>(triangles.size());
+
+	#pragma omp parallel for schedule(static)
+	for(long long i = 0; i < num_triangles; i++)
+	{
+		for(size_t j = 0; j < 3; j++)
+		{
+			if(short_indices)
+			{
+				const short unsigned int index = static_cast<short unsigned int>(triangles[i].vertex_indices[j]);
+				memcpy(&indices[(i*3 + j)*index_size], &index, index_size);
+			}
+			else
+			{
+				const unsigned int index = static_cast<unsigned int>(triangles[i].vertex_indices[j]);
+				memcpy(&indices[(i*3 + j)*index_size], &index, index_size);
+			}
 		}
 	}
 
-	// Write any remaining triangles in buffer to disk.
-	// This will occur whenever triangles.size() % buffer_width != 0
-	// (ie. when triangle count is not a multiple of buffer_width, which should happen almost all of the time).
-	if(buffer_count > 0)
+	ofstream out(file_name, ios_base::binary);
+
+	if(out.fail())
+		return false;
+
+	const unsigned int magic = 0x46546C67; // "glTF"
+	const unsigned int version = 2;
+	const unsigned int json_chunk_type = 0x4E4F534A; // "JSON"
+	const unsigned int bin_chunk_type = 0x004E4942; // "BIN\0"
+	const unsigned int json_chunk_length = json_string.size();
+	const unsigned int bin_chunk_length = bin_byte_length;
+	const unsigned int total_length = total_byte_length;
+
+	out.write(reinterpret_cast<const char *>(&magic), sizeof(unsigned int));
+	out.write(reinterpret_cast<const char *>(&version), sizeof(unsigned int));
+	out.write(reinterpret_cast<const char *>(&total_length), sizeof(unsigned int));
+
+	out.write(reinterpret_cast<const char *>(&json_chunk_length), sizeof(unsigned int));
+	out.write(reinterpret_cast<const char *>(&json_chunk_type), sizeof(unsigned int));
+	out.write(json_string.c_str(), json_chunk_length);
+
+	out.write(reinterpret_cast<const char *>(&bin_chunk_length), sizeof(unsigned int));
+	out.write(reinterpret_cast<const char *>(&bin_chunk_type), sizeof(unsigned int));
+	out.write(reinterpret_cast<const char *>(&vertices[0]), positions_byte_length);
+	out.write(&indices[0], indices_padded_byte_length);
+
+	if(out.fail())
+		return false;
+
+	out.close();
+
+	return true;
+}
+
+// Quantized mesh container layout (little-endian):
+// "QJM1", bits per axis, origin, quantum, vertex count, triangle count, then the range coded stream.
+// The stream holds one code per triangle corner: 0 introduces the next new vertex (followed by its
+// zigzag delta coded position), otherwise the code is how far back from the next new vertex the index is.
+static const char quantized_mesh_magic[4] = { 'Q', 'J', 'M', '1' };
+static const size_t varint_model_count = 5;
+
+static inline unsigned long long zigzag_encode(const long long value)
+{
+	return (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63);
+}
+
+static inline long long zigzag_decode(const unsigned long long value)
+{
+	return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+}
+
+// The most triangles that one byte of range coded stream can hold. Each bit decision costs at least
+// -log2(2017/2048), or about 0.022 bits, so each corner's code byte costs at least 0.176 bits,
+// and each triangle at least 0.53 bits.
+static const unsigned long long max_quantized_triangles_per_byte = 16;
+
+// Keep lattice points exact: spend enough bits on the lattice index, and the rest on sub-cell precision.
+static bool get_quantized_mesh_quantum(const float step_size, const size_t res, const size_t bits_per_axis, float &quantum)
+{
+	if(0 == step_size)
+		return false;
+
+	size_t lattice_bits = 0;
+
+	while((static_cast<size_t>(1) << lattice_bits) < res)
+		lattice_bits++;
+
+	if(bits_per_axis < lattice_bits || bits_per_axis > 30)
+		return false;
+
+	const size_t sub_bits = bits_per_axis - lattice_bits;
+	quantum = step_size / static_cast<float>(1 << sub_bits);
+
+	return true;
+}
+
+bool indexed_mesh::save_to_quantized_mesh_file(const char *const file_name, const float grid_min, const float step_size, const size_t res, const size_t bits_per_axis)
+{
+	if(false == finalized)
+		return false;
+
+	float quantum = 0;
+
+	if(0 == triangles.size() || false == get_quantized_mesh_quantum(step_size, res, bits_per_axis, quantum))
+		return false;
+
+	const long long max_q = (1LL << bits_per_axis) - 1;
+
+	// Renumber the vertices in order of first use, so that new vertices are always "the next one",
+	// and recently used vertices are a short distance back.
+	vector<size_t> new_indices(vertices.size(), static_cast<size_t>(-1));
+	size_t next_new_index = 0;
+
+	vector<unsigned char> payload;
+	payload.reserve(triangles.size()*4);
+	range_encoder encoder(payload);
+
+	adaptive_byte_model index_models[varint_model_count];
+	adaptive_byte_model position_models[3][varint_model_count];
+	long long previous_q[3] = { 0, 0, 0 };
+
+	for(size_t i = 0; i < triangles.size(); i++)
 	{
-		out.write(reinterpret_cast<const char *>(&buffer[0]), per_triangle_data_size*buffer_count);
+		for(size_t j = 0; j < 3; j++)
+		{
+			const size_t old_index = triangles[i].vertex_indices[j];
 
-		if(out.fail())
-			return false;
+			if(static_cast<size_t>(-1) != new_indices[old_index])
+			{
+				encoder.encode_varint(index_models, varint_model_count, next_new_index - new_indices[old_index]);
+				continue;
+			}
+
+			new_indices[old_index] = next_new_index++;
+			encoder.encode_varint(index_models, varint_model_count, 0);
+
+			const float p[3] = { vertices[old_index].x, vertices[old_index].y, vertices[old_index].z };
+
+			for(size_t k = 0; k < 3; k++)
+			{
+				long long q = static_cast<long long>(floor((p[k] - grid_min) / quantum + 0.5f));
+
+				if(q < 0)
+					q = 0;
+				else if(q > max_q)
+					q = max_q;
+
+				encoder.encode_varint(position_models[k], varint_model_count, zigzag_encode(q - previous_q[k]));
+				previous_q[k] = q;
+			}
+		}
 	}
 
+	encoder.flush();
+
+	ofstream out(file_name, ios_base::binary);
+
+	if(out.fail())
+		return false;
+
+	const unsigned int header_bits_per_axis = static_cast<unsigned int>(bits_per_axis);
+	const unsigned long long header_vertex_count = next_new_index;
+	const unsigned long long header_triangle_count = triangles.size();
+
+	out.write(quantized_mesh_magic, sizeof(quantized_mesh_magic));
+	out.write(reinterpret_cast<const char *>(&header_bits_per_axis), sizeof(unsigned int));
+	out.write(reinterpret_cast<const char *>(&grid_min), sizeof(float));
+	out.write(reinterpret_cast<const char *>(&quantum), sizeof(float));
+	out.write(reinterpret_cast<const char *>(&header_vertex_count), sizeof(unsigned long long));
+	out.write(reinterpret_cast<const char *>(&header_triangle_count), sizeof(unsigned long long));
+	out.write(reinterpret_cast<const char *>(&payload[0]), payload.size());
+
+	if(out.fail())
+		return false;
+
 	out.close();
 
 	return true;
 }
 
-float indexed_mesh::get_x_extent(void)
+bool indexed_mesh::load_from_quantized_mesh_file(const char *const file_name)
 {
-	float min = numeric_limits<float>::max();
-	float max = numeric_limits<float>::min();
+	init_triangle_insertion();
 
-	for(size_t i = 0; i < vertices.size(); i++)
+	ifstream in(file_name, ios_base::binary);
+
+	if(in.fail())
+	{
+		status_string = "Could not open the file.";
+		return false;
+	}
+
+	char magic[4];
+	unsigned int bits_per_axis = 0;
+	float grid_min = 0, quantum = 0;
+	unsigned long long vertex_count = 0, triangle_count = 0;
+
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char *>(&bits_per_axis), sizeof(unsigned int));
+	in.read(reinterpret_cast<char *>(&grid_min), sizeof(float));
+	in.read(reinterpret_cast<char *>(&quantum), sizeof(float));
+	in.read(reinterpret_cast<char *>(&vertex_count), sizeof(unsigned long long));
+	in.read(reinterpret_cast<char *>(&triangle_count), sizeof(unsigned long long));
+
+	if(in.fail() || 0 != memcmp(magic, quantized_mesh_magic, sizeof(magic)))
+	{
+		status_string = "Not a quantized mesh file.";
+		return false;
+	}
+
+	vector<unsigned char> payload((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+	// Don't trust the header with the allocation size: a stream this long can't hold more triangles than this.
+	if(0 == payload.size() || triangle_count > payload.size()*max_quantized_triangles_per_byte || vertex_count > triangle_count*3)
+	{
+		status_string = "The header's triangle or vertex count does not fit the length of the file.";
+		return false;
+	}
+
+	range_decoder decoder(&payload[0], payload.size());
+
+	adaptive_byte_model index_models[varint_model_count];
+	adaptive_byte_model position_models[3][varint_model_count];
+	long long previous_q[3] = { 0, 0, 0 };
+
+	vertices.reserve(vertex_count);
+	triangles.resize(triangle_count);
+
+	for(size_t i = 0; i < triangles.size(); i++)
+	{
+		for(size_t j = 0; j < 3; j++)
+		{
+			const unsigned long long code = decoder.decode_varint(index_models, varint_model_count);
+
+			if(0 != code)
+			{
+				if(code > vertices.size())
+				{
+					clear();
+					status_string = "The stream is corrupt.";
+					return false;
+				}
+
+				triangles[i].vertex_indices[j] = vertices.size() - code;
+				continue;
+			}
+
+			if(vertices.size() == vertex_count)
+			{
+				clear();
+				status_string = "The stream is corrupt.";
+				return false;
+			}
+
+			float p[3];
+
+			for(size_t k = 0; k < 3; k++)
+			{
+				previous_q[k] += zigzag_decode(decoder.decode_varint(position_models[k], varint_model_count));
+				p[k] = grid_min + previous_q[k]*quantum;
+			}
+
+			triangles[i].vertex_indices[j] = vertices.size();
+			vertices.push_back(vertex_3(p[0], p[1], p[2]));
+		}
+	}
+
+	if(false == decoder.is_ok() || vertices.size() != vertex_count)
 	{
-		if(vertices[i].x < min)
-			min = vertices[i].x;
+		clear();
+		status_string = "The stream is corrupt or truncated.";
+		return false;
+	}
 
-		if(vertices[i].x > max)
-			max = vertices[i].x;
+	// This sets the status string if the mesh is too large to finalize.
+	finalize_triangle_insertion();
+
+	if(false == finalized)
+	{
+		clear();
+		return false;
 	}
 
-	return fabsf(min - max);
+	return true;
 }
 
-float indexed_mesh::get_y_extent(void)
+bool indexed_mesh::check_quantized_mesh_file(const char *const file_name, const float grid_min, const float step_size, const size_t res, const size_t bits_per_axis)
 {
-	float min = numeric_limits<float>::max();
-	float max = numeric_limits<float>::min();
+	float quantum = 0;
 
-	for(size_t i = 0; i < vertices.size(); i++)
+	if(false == get_quantized_mesh_quantum(step_size, res, bits_per_axis, quantum))
+		return false;
+
+	indexed_mesh decoded;
+
+	if(false == decoded.load_from_quantized_mesh_file(file_name) || decoded.triangles.size() != triangles.size())
+		return false;
+
+	// The vertices are renumbered, but the triangles keep their order and their corners keep their order.
+	// Each coordinate is rounded to the nearest multiple of the quantum, plus float rounding in the decoder.
+	const long long num_triangles = static_cast<long long>(triangles.size());
+	long long bad_corner_count = 0;
+
+	#pragma omp parallel for schedule(static) reduction(+:bad_corner_count)
+	for(long long i = 0; i < num_triangles; i++)
 	{
-		if(vertices[i].y < min)
-			min = vertices[i].y;
+		for(size_t j = 0; j < 3; j++)
+		{
+			const vertex_3 &a = vertices[triangles[i].vertex_indices[j]];
+			const vertex_3 &b = decoded.vertices[decoded.triangles[i].vertex_indices[j]];
+			const float p[3] = { a.x, a.y, a.z };
+			const float q[3] = { b.x, b.y, b.z };
 
-		if(vertices[i].y > max)
-			max = vertices[i].y;
+			for(size_t k = 0; k < 3; k++)
+			{
+				const float max_error = 0.5f*quantum + 4*numeric_limits<float>::epsilon()*(fabs(grid_min) + fabs(p[k]));
+
+				if(fabs(p[k] - q[k]) > max_error)
+					bad_corner_count++;
+			}
+		}
 	}
 
-	return fabsf(min - max);
+	return 0 == bad_corner_count;
 }
 
-float indexed_mesh::get_z_extent(void)
+void indexed_mesh::write_stereo_lithography_records(char *const dest, const size_t first_triangle, const size_t triangle_count)
 {
-	float min = numeric_limits<float>::max();
-	float max = numeric_limits<float>::min();
-
-	for(size_t i = 0; i < vertices.size(); i++)
+	const long long count = static_cast<long long>(triangle_count);
+	const short unsigned int attribute_byte_count = 0;
+
+	// Each triangle owns a disjoint 50-byte record, so the threads never share output.
+	// The normals are left scalar; the loop is bound by the vertex gathers, and copying the corners
+	// out into arrays so that the cross products could vectorize measured slower.
+	#pragma omp parallel for schedule(static)
+	for(long long i = 0; i < count; i++)
 	{
-		if(vertices[i].z < min)
-			min = vertices[i].z;
+		const indexed_triangle &t = triangles[first_triangle + i];
+		const vertex_3 &a = vertices[t.vertex_indices[0]];
+		const vertex_3 &b = vertices[t.vertex_indices[1]];
+		const vertex_3 &c = vertices[t.vertex_indices[2]];
 
-		if(vertices[i].z > max)
-			max = vertices[i].z;
+		vertex_3 normal = (b - a).cross(c - a);
+		normal.normalize();
+
+		// Assemble the record on the stack, then copy it out in one go.
+		const float record[12] = { normal.x, normal.y, normal.z, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z };
+		char *cp = dest + stl_per_triangle_data_size*i;
+
+		memcpy(cp, record, sizeof(record));
+		memcpy(cp + sizeof(record), &attribute_byte_count, sizeof(short unsigned int));
 	}
+}
 
-	return fabsf(min - max);
+float indexed_mesh::get_x_extent(void)
+{
+	mesh_statistics stats;
+	get_statistics(stats);
+
+	return stats.max_corner.x - stats.min_corner.x;
+}
+
+float indexed_mesh::get_y_extent(void)
+{
+	mesh_statistics stats;
+	get_statistics(stats);
+
+	return stats.max_corner.y - stats.min_corner.y;
+}
+
+float indexed_mesh::get_z_extent(void)
+{
+	mesh_statistics stats;
+	get_statistics(stats);
+
+	return stats.max_corner.z - stats.min_corner.z;
 }
 
 float indexed_mesh::get_triangle_area(const size_t tri_index)
@@ -262,12 +889,10 @@ float indexed_mesh::get_triangle_area(const size_t tri_index)
 
 float indexed_mesh::get_area(void)
 {
-	float total_area = 0;
+	mesh_statistics stats;
+	get_statistics(stats);
 
-	for(size_t i = 0; i < triangles.size(); i++)
-		total_area += get_triangle_area(i);
-
-	return total_area;
+	return static_cast<float>(stats.area);
 }
 
 float indexed_mesh::get_triangle_volume(const size_t tri_index)
@@ -284,25 +909,143 @@ float indexed_mesh::get_triangle_volume(const size_t tri_index)
 
 float indexed_mesh::get_volume(void)
 {
-	float total_volume = 0;
+	mesh_statistics stats;
+	get_statistics(stats);
 
-	for(size_t i = 0; i < triangles.size(); i++)
-		total_volume += get_triangle_volume(i);
+	return static_cast<float>(stats.volume);
+}
 
-	return total_volume;
+// Compensated (Kahan) summation, so that the sums stay accurate over hundreds of millions of terms.
+class kahan_sum
+{
+public:
+	kahan_sum(void) : sum(0), compensation(0) {}
+
+	inline void add(const double value)
+	{
+		const double y = value - compensation;
+		const double t = sum + y;
+		compensation = (t - sum) - y;
+		sum = t;
+	}
+
+	double sum, compensation;
+};
+
+bool indexed_mesh::get_statistics(mesh_statistics &stats)
+{
+	// The extent, area and volume getters all come through here, so only the first call makes the pass.
+	if(true == statistics_cached)
+	{
+		stats = cached_statistics;
+		return true;
+	}
+
+	stats = mesh_statistics();
+
+	if(0 == triangles.size())
+		return false;
+
+	const long long num_triangles = static_cast<long long>(triangles.size());
+	const vertex_3 *const v = &vertices[0];
+	const indexed_triangle *const t = &triangles[0];
+
+	stats.min_corner = stats.max_corner = v[t[0].vertex_indices[0]];
+	kahan_sum area, volume, normal_x, normal_y, normal_z;
+	long long zero_area_triangle_count = 0;
+
+	// A single pass over the triangles gathers the three corners once and derives everything from them.
+	// The loop is scalar: it is bound by the indexed vertex gathers, and a blocked SIMD version that copied
+	// the corners out into arrays first measured slower.
+	#pragma omp parallel
+	{
+		vertex_3 local_min = stats.min_corner, local_max = stats.max_corner;
+		kahan_sum local_area, local_volume, local_normal_x, local_normal_y, local_normal_z;
+		long long local_zero_area_count = 0;
+
+		#pragma omp for schedule(static) nowait
+		for(long long i = 0; i < num_triangles; i++)
+		{
+			const vertex_3 &a = v[t[i].vertex_indices[0]];
+			const vertex_3 &b = v[t[i].vertex_indices[1]];
+			const vertex_3 &c = v[t[i].vertex_indices[2]];
+
+			local_min.x = std::min(local_min.x, std::min(a.x, std::min(b.x, c.x)));
+			local_min.y = std::min(local_min.y, std::min(a.y, std::min(b.y, c.y)));
+			local_min.z = std::min(local_min.z, std::min(a.z, std::min(b.z, c.z)));
+			local_max.x = std::max(local_max.x, std::max(a.x, std::max(b.x, c.x)));
+			local_max.y = std::max(local_max.y, std::max(a.y, std::max(b.y, c.y)));
+			local_max.z = std::max(local_max.z, std::max(a.z, std::max(b.z, c.z)));
+
+			// Edge vectors and cross products in double precision.
+			const double e0x = static_cast<double>(b.x) - a.x, e0y = static_cast<double>(b.y) - a.y, e0z = static_cast<double>(b.z) - a.z;
+			const double e1x = static_cast<double>(c.x) - a.x, e1y = static_cast<double>(c.y) - a.y, e1z = static_cast<double>(c.z) - a.z;
+			const double nx = e0y*e1z - e0z*e1y;
+			const double ny = e0z*e1x - e0x*e1z;
+			const double nz = e0x*e1y - e0y*e1x;
+			const double double_area = sqrt(nx*nx + ny*ny + nz*nz);
+
+			if(0 == double_area)
+				local_zero_area_count++;
+
+			local_area.add(0.5*double_area);
+			local_normal_x.add(0.5*nx);
+			local_normal_y.add(0.5*ny);
+			local_normal_z.add(0.5*nz);
+
+			// Signed volume of the tetrahedron formed by the triangle and the origin: a . (b x c) / 6.
+			const double bcx = static_cast<double>(b.y)*c.z - static_cast<double>(b.z)*c.y;
+			const double bcy = static_cast<double>(b.z)*c.x - static_cast<double>(b.x)*c.z;
+			const double bcz = static_cast<double>(b.x)*c.y - static_cast<double>(b.y)*c.x;
+			local_volume.add((a.x*bcx + a.y*bcy + a.z*bcz) / 6.0);
+		}
+
+		#pragma omp critical
+		{
+			stats.min_corner.x = std::min(stats.min_corner.x, local_min.x);
+			stats.min_corner.y = std::min(stats.min_corner.y, local_min.y);
+			stats.min_corner.z = std::min(stats.min_corner.z, local_min.z);
+			stats.max_corner.x = std::max(stats.max_corner.x, local_max.x);
+			stats.max_corner.y = std::max(stats.max_corner.y, local_max.y);
+			stats.max_corner.z = std::max(stats.max_corner.z, local_max.z);
+
+			area.add(local_area.sum);
+			volume.add(local_volume.sum);
+			normal_x.add(local_normal_x.sum);
+			normal_y.add(local_normal_y.sum);
+			normal_z.add(local_normal_z.sum);
+			zero_area_triangle_count += local_zero_area_count;
+		}
+	}
+
+	stats.area = area.sum;
+	stats.volume = volume.sum;
+	stats.zero_area_triangle_count = static_cast<size_t>(zero_area_triangle_count);
+
+	if(0 < stats.area)
+		stats.normal_closure = sqrt(normal_x.sum*normal_x.sum + normal_y.sum*normal_y.sum + normal_z.sum*normal_z.sum) / stats.area;
+
+	// Triangles can still be inserted until the mesh is finalized.
+	cached_statistics = stats;
+	statistics_cached = finalized;
+
+	return true;
 }
 
 size_t indexed_mesh::get_degenerate_triangle_count(void)
 {
-	size_t degenerate_count = 0;
+	const long long num_triangles = static_cast<long long>(triangles.size());
+	long long degenerate_count = 0;
 
-	for(size_t i = 0; i < triangles.size(); i++)
+	#pragma omp parallel for schedule(static) reduction(+:degenerate_count)
+	for(long long i = 0; i < num_triangles; i++)
 	{
 		size_t v0 = triangles[i].vertex_indices[0];
 		size_t v1 = triangles[i].vertex_indices[1];
 		size_t v2 = triangles[i].vertex_indices[2];
 
-		if( vertices[v0] == vertices[v1] ||
+		if( v0 == v1 || v0 == v2 || v1 == v2 ||
+			vertices[v0] == vertices[v1] ||
 			vertices[v0] == vertices[v2] ||
 			vertices[v1] == vertices[v2] )
 		{
@@ -310,53 +1053,174 @@ size_t indexed_mesh::get_degenerate_triangle_count(void)
 		}
 	}
 
-	return degenerate_count;
+	return static_cast<size_t>(degenerate_count);
 }
 
 size_t indexed_mesh::get_problem_edge_count(void)
 {
-	// Find edges that belong to only one triangle.
-	set<ordered_indexed_edge> problem_edges_set;
-	size_t problem_edge_id = 0;
+	mesh_validation_report report;
 
-	// For each vertex.
-	for(size_t i = 0; i < vertices.size(); i++)
+	if(false == validate(report))
+		return 0;
+
+	return report.problem_edge_count;
+}
+
+// Union-find helper used to count connected components.
+static size_t find_root(vector<size_t> &parents, size_t i)
+{
+	while(parents[i] != i)
 	{
-		// For each edge.
-		for(size_t j = 0; j < vertex_to_vertex_indices[i].size(); j++)
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+
+	return i;
+}
+
+bool indexed_mesh::validate(mesh_validation_report &report)
+{
+	report = mesh_validation_report();
+
+	if(false == finalized)
+		return false;
+
+	if(0 == triangles.size())
+		return true;
+
+	report.degenerate_triangle_count = get_degenerate_triangle_count();
+
+	// Count the incidences of each undirected edge.
+	// Once the edge keys are sorted, each run of equal keys is one edge, and the run length is its triangle count.
+	vector<unsigned long long> edge_keys;
+	get_sorted_edge_keys(edge_keys);
+
+	const long long num_keys = static_cast<long long>(edge_keys.size());
+	long long boundary_edge_count = 0;
+	long long non_manifold_edge_count = 0;
+	vector<unsigned long long> boundary_edges;
+
+	#pragma omp parallel
+	{
+		vector<unsigned long long> local_boundary_edges;
+
+		#pragma omp for schedule(static) reduction(+:boundary_edge_count, non_manifold_edge_count)
+		for(long long i = 0; i < num_keys; i++)
 		{
-			size_t neighbour_j = vertex_to_vertex_indices[i][j];
+			// Only look at the start of each run.
+			if(0 < i && edge_keys[i - 1] == edge_keys[i])
+				continue;
+
+			long long run_end = i + 1;
 
-			vector<size_t> tri_indices;
-			get_triangles_shared_by_vertex_pair(i, neighbour_j, tri_indices);
+			while(run_end < num_keys && edge_keys[run_end] == edge_keys[i])
+				run_end++;
 
-			// Found a problem edge.
-			if(2 != tri_indices.size())
+			if(1 == run_end - i)
 			{
-				indexed_vertex_3 v0;
-				v0.index = i;
-				v0.x = vertices[i].x;
-				v0.y = vertices[i].y;
-				v0.z = vertices[i].z;
+				boundary_edge_count++;
+				local_boundary_edges.push_back(edge_keys[i]);
+			}
+			else if(2 < run_end - i)
+			{
+				non_manifold_edge_count++;
+			}
+		}
 
-				indexed_vertex_3 v1;
-				v1.index = neighbour_j;
-				v1.x = vertices[neighbour_j].x;
-				v1.y = vertices[neighbour_j].y;
-				v1.z = vertices[neighbour_j].z;
+		#pragma omp critical
+		boundary_edges.insert(boundary_edges.end(), local_boundary_edges.begin(), local_boundary_edges.end());
+	}
 
-				ordered_indexed_edge problem_edge(v0, v1);
+	report.boundary_edge_count = static_cast<size_t>(boundary_edge_count);
+	report.non_manifold_edge_count = static_cast<size_t>(non_manifold_edge_count);
+	report.problem_edge_count = report.boundary_edge_count + report.non_manifold_edge_count;
 
-				if(problem_edges_set.end() == problem_edges_set.find(problem_edge))
-				{
-					problem_edge.id = problem_edge_id++;
-					problem_edges_set.insert(problem_edge);
-				}
-			} // End of: Found a problem edge.
-		} // End of: For each edge.
-	} // End of: For each vertex.
+	// Count boundary loops as the connected components of the boundary edge graph.
+	if(0 < boundary_edges.size())
+	{
+		vector<unsigned int> boundary_vertices;
+		boundary_vertices.reserve(boundary_edges.size()*2);
+
+		for(size_t i = 0; i < boundary_edges.size(); i++)
+		{
+			boundary_vertices.push_back(static_cast<unsigned int>(boundary_edges[i] >> 32));
+			boundary_vertices.push_back(static_cast<unsigned int>(boundary_edges[i] & 0xffffffff));
+		}
+
+		sort(boundary_vertices.begin(), boundary_vertices.end());
+		boundary_vertices.erase(unique(boundary_vertices.begin(), boundary_vertices.end()), boundary_vertices.end());
+
+		vector<size_t> parents(boundary_vertices.size());
+
+		for(size_t i = 0; i < parents.size(); i++)
+			parents[i] = i;
+
+		for(size_t i = 0; i < boundary_edges.size(); i++)
+		{
+			size_t a = lower_bound(boundary_vertices.begin(), boundary_vertices.end(), static_cast<unsigned int>(boundary_edges[i] >> 32)) - boundary_vertices.begin();
+			size_t b = lower_bound(boundary_vertices.begin(), boundary_vertices.end(), static_cast<unsigned int>(boundary_edges[i] & 0xffffffff)) - boundary_vertices.begin();
+
+			parents[find_root(parents, a)] = find_root(parents, b);
+		}
+
+		for(size_t i = 0; i < parents.size(); i++)
+			if(find_root(parents, i) == i)
+				report.boundary_loop_count++;
+	}
+
+	// Find non-manifold vertices.
+	// The triangles around a manifold vertex form a single fan, so the edges opposite to the vertex
+	// (its link) must form one connected path or cycle.
+	const long long num_vertices = static_cast<long long>(vertices.size());
+	long long non_manifold_vertex_count = 0;
+
+	#pragma omp parallel
+	{
+		vector<size_t> parents;
+
+		#pragma omp for schedule(dynamic, 4096) reduction(+:non_manifold_vertex_count)
+		for(long long i = 0; i < num_vertices; i++)
+		{
+			const unsigned int *const neighbours_begin = &vertex_to_vertex_indices[0] + vertex_to_vertex_offsets[i];
+			const unsigned int *const neighbours_end = &vertex_to_vertex_indices[0] + vertex_to_vertex_offsets[i + 1];
+			const size_t num_neighbours = neighbours_end - neighbours_begin;
+
+			if(0 == num_neighbours)
+				continue;
+
+			parents.resize(num_neighbours);
+
+			for(size_t j = 0; j < num_neighbours; j++)
+				parents[j] = j;
+
+			for(size_t j = vertex_to_triangle_offsets[i]; j < vertex_to_triangle_offsets[i + 1]; j++)
+			{
+				const indexed_triangle &t = triangles[vertex_to_triangle_indices[j]];
+				size_t link[2];
+				size_t link_count = 0;
 
-	return problem_edges_set.size();
+				for(size_t k = 0; k < 3; k++)
+					if(static_cast<size_t>(i) != t.vertex_indices[k] && 2 > link_count)
+						link[link_count++] = lower_bound(neighbours_begin, neighbours_end, static_cast<unsigned int>(t.vertex_indices[k])) - neighbours_begin;
+
+				if(2 == link_count)
+					parents[find_root(parents, link[0])] = find_root(parents, link[1]);
+			}
+
+			size_t component_count = 0;
+
+			for(size_t j = 0; j < num_neighbours; j++)
+				if(find_root(parents, j) == j)
+					component_count++;
+
+			if(1 < component_count)
+				non_manifold_vertex_count++;
+		}
+	}
+
+	report.non_manifold_vertex_count = static_cast<size_t>(non_manifold_vertex_count);
+
+	return true;
 }
 
 size_t indexed_mesh::get_triangle_count(void)
@@ -373,27 +1237,79 @@ void indexed_mesh::clear(void)
 {
 	triangles.clear();
 	vertices.clear();
+	vertex_to_triangle_offsets.clear();
 	vertex_to_triangle_indices.clear();
+	vertex_to_vertex_offsets.clear();
 	vertex_to_vertex_indices.clear();
 	vertex_set.clear();
+	statistics_cached = false;
 }
 
-void indexed_mesh::get_triangles_shared_by_vertex_pair(const size_t v0, const size_t v1, vector<size_t> &triangle_indices)
+void indexed_mesh::get_sorted_edge_keys(vector<unsigned long long> &edge_keys)
 {
-	triangle_indices.clear();
+	// Pack each undirected edge into a 64-bit key: smaller vertex index in the high 32 bits.
+	const long long num_triangles = static_cast<long long>(triangles.size());
+	edge_keys.resize(triangles.size()*3);
 
-	for(size_t i = 0; i < vertex_to_triangle_indices[v0].size(); i++)
+	#pragma omp parallel for schedule(static)
+	for(long long i = 0; i < num_triangles; i++)
 	{
-		for(size_t j = 0; j < vertex_to_triangle_indices[v1].size(); j++)
+		for(size_t j = 0; j < 3; j++)
 		{
-			size_t tri0_index = vertex_to_triangle_indices[v0][i];
-			size_t tri1_index = vertex_to_triangle_indices[v1][j];
+			unsigned long long a = triangles[i].vertex_indices[j];
+			unsigned long long b = triangles[i].vertex_indices[(j + 1) % 3];
 
-			if(tri0_index == tri1_index)
+			if(a > b)
 			{
-				triangle_indices.push_back(tri0_index);
-				break;
+				unsigned long long temp = a;
+				a = b;
+				b = temp;
 			}
+
+			edge_keys[i*3 + j] = (a << 32) | b;
 		}
 	}
+
+#ifdef _OPENMP
+	// Sort one chunk per thread, then merge neighbouring chunks pairwise.
+	const long long num_chunks = omp_get_max_threads();
+	vector<size_t> chunk_bounds(num_chunks + 1);
+
+	for(long long i = 0; i <= num_chunks; i++)
+		chunk_bounds[i] = edge_keys.size()*i / num_chunks;
+
+	#pragma omp parallel for schedule(static, 1)
+	for(long long i = 0; i < num_chunks; i++)
+		sort(edge_keys.begin() + chunk_bounds[i], edge_keys.begin() + chunk_bounds[i + 1]);
+
+	for(long long width = 1; width < num_chunks; width *= 2)
+	{
+		#pragma omp parallel for schedule(static, 1)
+		for(long long i = 0; i < num_chunks - width; i += 2*width)
+		{
+			const long long last = (i + 2*width < num_chunks) ? i + 2*width : num_chunks;
+			inplace_merge(edge_keys.begin() + chunk_bounds[i], edge_keys.begin() + chunk_bounds[i + width], edge_keys.begin() + chunk_bounds[last]);
+		}
+	}
+#else
+	sort(edge_keys.begin(), edge_keys.end());
+#endif
+}
+
+void indexed_mesh::get_vertex_neighbours(const size_t vertex_index, vector<unsigned int> &neighbours)
+{
+	neighbours.clear();
+
+	for(size_t i = vertex_to_triangle_offsets[vertex_index]; i < vertex_to_triangle_offsets[vertex_index + 1]; i++)
+	{
+		const indexed_triangle &t = triangles[vertex_to_triangle_indices[i]];
+
+		for(size_t k = 0; k < 3; k++)
+			if(vertex_index != t.vertex_indices[k]) // Don't add current vertex index to its own adjacency list.
+				neighbours.push_back(static_cast<unsigned int>(t.vertex_indices[k]));
+	}
+
+	// Remove duplicates.
+	sort(neighbours.begin(), neighbours.end());
+	neighbours.erase(unique(neighbours.begin(), neighbours.end()), neighbours.end());
 }
@@ -2,6 +2,7 @@
 #define MESH_H
 
 #include "primitives.h"
+#include "range_coder.h"
 
 #include <iostream>
 using std::cout;
@@ -27,16 +28,114 @@ using std::vector;
 #include <limits>
 using std::numeric_limits;
 
+#include <algorithm>
+using std::sort;
+using std::unique;
+using std::lower_bound;
+using std::inplace_merge;
+
+#include <string>
+using std::string;
+
+#include <sstream>
+using std::ostringstream;
+
+#include <iterator>
+using std::istreambuf_iterator;
+
 #include <cstring> // for memcpy()
+#include <cstdio> // for snprintf()
 #include <cctype>
 
+#if defined(__has_include)
+	#if __has_include(<charconv>)
+		#include <charconv>
+	#endif
+#endif
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#define QJS_HAVE_MMAP
+#endif
+
+
+class mesh_validation_report
+{
+public:
+	mesh_validation_report(void)
+	{
+		problem_edge_count = 0;
+		boundary_edge_count = 0;
+		non_manifold_edge_count = 0;
+		non_manifold_vertex_count = 0;
+		boundary_loop_count = 0;
+		degenerate_triangle_count = 0;
+	}
+
+	size_t problem_edge_count; // Edges not shared by exactly two triangles.
+	size_t boundary_edge_count; // Edges used by only one triangle (cracks, holes).
+	size_t non_manifold_edge_count; // Edges shared by more than two triangles.
+	size_t non_manifold_vertex_count; // Vertices whose triangle fan is not a single connected disk.
+	size_t boundary_loop_count; // Connected chains of boundary edges.
+	size_t degenerate_triangle_count;
+};
+
+
+class mesh_statistics
+{
+public:
+	mesh_statistics(void)
+	{
+		area = 0;
+		volume = 0;
+		normal_closure = 0;
+		zero_area_triangle_count = 0;
+	}
+
+	vertex_3 min_corner, max_corner;
+	double area;
+	double volume;
+	double normal_closure; // Length of the area-weighted normal sum divided by the area; near zero for a closed, consistently oriented mesh.
+	size_t zero_area_triangle_count;
+};
+
+
+// Binary Stereo Lithography layout: an 80-byte header and a 4-byte triangle count, then one record per triangle
+// of twelve 4-byte floats (normal and three corners) plus one 2-byte attribute byte count.
+const size_t stl_header_size = 80;
+const size_t stl_per_triangle_data_size = 12*sizeof(float) + sizeof(short unsigned int);
+
+
+// The largest vertex or triangle index that the adjacency lists can hold.
+const size_t max_adjacency_index = 0xffffffff;
+
+
+// Receives the triangles produced by the tesselator.
+class triangle_sink
+{
+public:
+	virtual ~triangle_sink(void) {}
+
+	virtual void init_triangle_insertion(void) = 0;
+	virtual void insert_triangle(const triangle &src_tri) = 0;
+	virtual void finalize_triangle_insertion(void) = 0;
+};
+
 
-class indexed_mesh
+class indexed_mesh : public triangle_sink
 {
 public:
 	indexed_mesh(void)
 	{
 		finalized = false;
+		statistics_cached = false;
+		status_string = "OK";
 	}
 
 	bool operator==(const indexed_mesh &right);
@@ -45,7 +144,15 @@ public:
 	void init_triangle_insertion(void);
 	void insert_triangle(const triangle &src_tri);
 	void finalize_triangle_insertion(void);
-	bool save_to_binary_stereo_lithography_file(const char *const file_name, const size_t buffer_width = 65536);
+	bool save_to_binary_stereo_lithography_file(const char *const file_name, const size_t buffer_width = 1048576);
+	bool save_to_binary_polygon_file(const char *const file_name, const size_t buffer_width = 1048576);
+	bool save_to_wavefront_obj_file(const char *const file_name, const size_t block_width = 65536);
+	bool save_to_gltf_binary_file(const char *const file_name);
+	bool save_to_quantized_mesh_file(const char *const file_name, const float grid_min, const float step_size, const size_t res, const size_t bits_per_axis = 21);
+	bool load_from_quantized_mesh_file(const char *const file_name);
+
+	// Reads a quantized mesh file back, and checks that it holds this mesh to within the quantization error.
+	bool check_quantized_mesh_file(const char *const file_name, const float grid_min, const float step_size, const size_t res, const size_t bits_per_axis = 21);
 
 	float get_x_extent(void);
 	float get_y_extent(void);
@@ -54,22 +161,50 @@ public:
 	float get_area(void);
 	float get_triangle_volume(const size_t tri_index);
 	float get_volume(void);
+	bool get_statistics(mesh_statistics &stats);
 	size_t get_degenerate_triangle_count(void);
 	size_t get_problem_edge_count(void);
+	bool validate(mesh_validation_report &report);
 	size_t get_triangle_count(void);
 	size_t get_vertex_count(void);
 
+	// False if finalize_triangle_insertion() has not been called, or if the mesh was too large to finalize.
+	inline bool is_finalized(void) const { return finalized; }
+
+	// Says why finalizing or loading the mesh failed.
+	inline string get_status_string(void) const { return status_string; }
+
+	// Raw arrays, for callers that hand the mesh on to their own code.
+	inline const vector<vertex_3> &get_vertices(void) { return vertices; }
+	inline const vector<indexed_triangle> &get_triangles(void) { return triangles; }
+
 protected:
 	void clear(void);
-	void get_triangles_shared_by_vertex_pair(const size_t v0, const size_t v1, vector<size_t> &triangle_indices);
+	void get_sorted_edge_keys(vector<unsigned long long> &edge_keys);
+#ifdef QJS_HAVE_MMAP
+	bool save_to_binary_stereo_lithography_mapping(const char *const file_name, const size_t buffer_width);
+#endif
+	void write_stereo_lithography_records(char *const dest, const size_t first_triangle, const size_t triangle_count);
+
+	void get_vertex_neighbours(const size_t vertex_index, vector<unsigned int> &neighbours);
 
 	vector<vertex_3> vertices;
 	vector<indexed_triangle> triangles;
-	vector< vector<size_t> > vertex_to_vertex_indices;
-	vector< vector<size_t> > vertex_to_triangle_indices;
+
+	// Adjacency data is stored in compressed sparse row form:
+	// the neighbours of vertex i are found at [offsets[i], offsets[i + 1]) in the flat index array.
+	vector<size_t> vertex_to_vertex_offsets;
+	vector<unsigned int> vertex_to_vertex_indices;
+	vector<size_t> vertex_to_triangle_offsets;
+	vector<unsigned int> vertex_to_triangle_indices;
 
 	bool finalized;
 	set<indexed_vertex_3> vertex_set;
+	string status_string;
+
+	// Filled in by the first call to get_statistics() after the mesh is finalized.
+	mesh_statistics cached_statistics;
+	bool statistics_cached;
 };
 
 
@@ -5,15 +5,32 @@
 #include "quaternion_julia_set.h"
 
 
-quaternion_julia_set::quaternion_julia_set(const bool src_force_cpu)
+// Upper bound on the size of the GL slab atlas, in texels (16 MB at one byte per texel).
+static const size_t max_atlas_texels = 4096*4096;
+
+quaternion_julia_set::quaternion_julia_set(const bool src_force_cpu) : log_output(cout.rdbuf())
 {
 	force_cpu = src_force_cpu;
+	stream_output = false;
+	memory_mapped_grids = false;
+	grid_backing_file_count = 0;
+	progressive = false;
+	verify_output = false;
+	method = MARCHING_CUBES;
+	write_shader_files = true;
+	progress_function = 0;
+	progress_user_data = 0;
+	cancel_token = 0;
+	time_budget_seconds = 0;
+	reduced_res_for_budget = false;
 
 	res = 100;
 	vertex_refinement_steps = 0;
+	configured_res = res;
+	configured_vertex_refinement_steps = vertex_refinement_steps;
 	shell_thickness = 0;
 	grid_max = 1.5;
-	grid_min = -grid_min;
+	grid_min = -grid_max;
 	z_w = 0;
 	C.x = 0.3f;
 	C.y = 0.5f;
@@ -28,11 +45,56 @@ quaternion_julia_set::quaternion_julia_set(const bool src_force_cpu)
 	// This can only be set to true once the equation has been successfully set up.
 	parameters_configured = false;
 
+	headless_context = false;
+
+#ifdef QJS_USE_EGL
+	egl_display = EGL_NO_DISPLAY;
+	egl_context = EGL_NO_CONTEXT;
+
+	// GLUT can't open a window without a display (and exits if it tries), so go without one.
+	const char *const display_name = getenv("DISPLAY");
+
+	if(false == force_cpu && (0 == display_name || '\0' == display_name[0]))
+		headless_context = true;
+#endif
+
 	if(true == force_cpu)
 	{
 		status_string = "Forcing CPU-only mode.";
 		opengl_init_ok = false;
 	}
+#ifdef QJS_USE_EGL
+	else if(true == headless_context)
+	{
+		if(false == create_headless_context())
+		{
+			status_string += " -- forcing CPU-only mode.";
+			opengl_init_ok = false;
+		}
+		else
+		{
+			// A GLEW built for GLX reports that there is no GLX display, but only after it has loaded the OpenGL entry points.
+			const GLenum glew_result = glewInit();
+
+			if(!((GLEW_OK == glew_result || GLEW_ERROR_NO_GLX_DISPLAY == glew_result) &&
+				 GLEW_VERSION_2_0 &&
+				 GLEW_ARB_framebuffer_object &&
+				 GLEW_ARB_texture_rectangle &&
+				 GLEW_ARB_texture_non_power_of_two))
+			{
+				status_string = "OpenGL 2.0 initialization failure on the headless EGL context -- forcing CPU-only mode.";
+				opengl_init_ok = false;
+			}
+			else
+			{
+				status_string = "OpenGL 2.0 initialization successful (headless EGL context, ";
+				status_string += reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+				status_string += ").";
+				opengl_init_ok = true;
+			}
+		}
+	}
+#endif
 	else
 	{
 		// Initialize the OpenGL context using the GLUT helper library.
@@ -68,13 +130,89 @@ quaternion_julia_set::quaternion_julia_set(const bool src_force_cpu)
 
 quaternion_julia_set::~quaternion_julia_set(void)
 {
+#ifdef QJS_USE_EGL
+	if(true == headless_context)
+	{
+		if(EGL_NO_DISPLAY != egl_display)
+		{
+			eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+			if(EGL_NO_CONTEXT != egl_context)
+				eglDestroyContext(egl_display, egl_context);
+
+			eglTerminate(egl_display);
+		}
+
+		return;
+	}
+#endif
+
 	if(false == force_cpu)
 		glutDestroyWindow(glut_window_handle);
 }
 
+#ifdef QJS_USE_EGL
+bool quaternion_julia_set::create_headless_context(void)
+{
+	// Prefer Mesa's surfaceless platform, which needs neither a window system nor a GPU.
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+	if(0 != get_platform_display)
+		egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+
+	if(EGL_NO_DISPLAY == egl_display)
+		egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major_version = 0, minor_version = 0;
+
+	if(EGL_NO_DISPLAY == egl_display || EGL_FALSE == eglInitialize(egl_display, &major_version, &minor_version))
+	{
+		egl_display = EGL_NO_DISPLAY;
+		status_string = "EGL initialization failure";
+		return false;
+	}
+
+	if(EGL_FALSE == eglBindAPI(EGL_OPENGL_API))
+	{
+		status_string = "EGL does not support desktop OpenGL";
+		return false;
+	}
+
+	const EGLint context_attributes[] = { EGL_NONE };
+
+	// Everything is drawn to framebuffer objects, so the context needs no config and no surface.
+	egl_context = eglCreateContext(egl_display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attributes);
+
+	if(EGL_NO_CONTEXT == egl_context)
+	{
+		// Without EGL_KHR_no_config_context, any OpenGL capable config will do.
+		const EGLint config_attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config;
+		EGLint config_count = 0;
+
+		if(EGL_TRUE == eglChooseConfig(egl_display, config_attributes, &config, 1, &config_count) && 0 < config_count)
+			egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attributes);
+	}
+
+	if(EGL_NO_CONTEXT == egl_context)
+	{
+		status_string = "EGL context creation failure";
+		return false;
+	}
+
+	if(EGL_FALSE == eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context))
+	{
+		status_string = "EGL surfaceless context failure";
+		return false;
+	}
+
+	return true;
+}
+#endif
+
 bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 {
-	addsub_blocks.clear();
+	quaternion_julia_set_parameters p;
 
 	vector<string> tokens;
 	parameters_configured = false;
@@ -95,10 +233,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 	if("" == line) return false;
 
 	iss.str(line);
-	iss	>> res;
-
-	if(res < 1 || res > 100000)
-		res = 100;
+	iss	>> p.res;
 
 	// Get vertex refinement steps.
 	getline(config_file, line);
@@ -109,10 +244,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> vertex_refinement_steps;
-
-	if(vertex_refinement_steps < 0 || vertex_refinement_steps > 1000)
-		vertex_refinement_steps = 0;
+	iss	>> p.vertex_refinement_steps;
 
 	// Get shell thickness.
 	getline(config_file, line);
@@ -123,12 +255,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> shell_thickness;
-
-	if(shell_thickness < 0)
-		shell_thickness = 0;
-	else if(shell_thickness > 1)
-		shell_thickness = 1;
+	iss	>> p.shell_thickness;
 
 	// Get grid extent.
 	getline(config_file, line);
@@ -139,7 +266,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> grid_min;
+	iss	>> p.grid_min;
 
 	getline(config_file, line);
 	if("" == line) return false;
@@ -149,24 +276,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> grid_max;
-
-	if(grid_min == grid_max)
-	{
-		grid_min = -1.5;
-		grid_max = 1.5;
-	}
-	else if(grid_min > grid_max)
-	{
-		float min = grid_max;
-		float max = grid_min;
-
-		grid_min = min;
-		grid_max = max;
-	}
-
-	// Set step size now that we have res and grid extent parameters
-	step_size = (grid_max - grid_min) / (res - 1);
+	iss	>> p.grid_max;
 
 	// Get max iterations.
 	getline(config_file, line);
@@ -177,7 +287,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> max_iterations;
+	iss	>> p.max_iterations;
 
 	// Get threshold.
 	getline(config_file, line);
@@ -188,7 +298,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> threshold;
+	iss	>> p.threshold;
 
 	// Get Z.w.
 	getline(config_file, line);
@@ -199,7 +309,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> z_w;
+	iss	>> p.z_w;
 
 	// Get C.
 	getline(config_file, line);
@@ -210,7 +320,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> C.x;
+	iss	>> p.C.x;
 
 	getline(config_file, line);
 	if("" == line) return false;
@@ -220,7 +330,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> C.y;
+	iss	>> p.C.y;
 
 	getline(config_file, line);
 	if("" == line) return false;
@@ -230,7 +340,7 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> C.z;
+	iss	>> p.C.z;
 
 	getline(config_file, line);
 	if("" == line) return false;
@@ -240,21 +350,13 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 
 	iss.clear();
 	iss.str(line);
-	iss	>> C.w;
+	iss	>> p.C.w;
 
 	// Get equation text.
 	getline(config_file, line);
 	if("" == line) return false;
 	tokens = stl_str_tok("//", line);
-	equation_text = tokens[0];
-
-	string error_string;
-
-	if(false == setup_equation_text(equation_text, error_string))
-	{
-		status_string = "Error parsing formula -- " + error_string;
-		return false;
-	}
+	p.equation_text = tokens[0];
 
 
 	// To do: change stlstrtok to keep adding to current string until last components of current string are the token
@@ -324,6 +426,77 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 		iss.str(tokens[6]);
 		iss	>> b.end_z;
 
+		p.addsub_blocks.push_back(b);
+	}
+
+	return set_parameters(p);
+}
+
+bool quaternion_julia_set::set_parameters(const quaternion_julia_set_parameters &p)
+{
+	parameters_configured = false;
+
+	res = p.res;
+
+	if(res < 1 || res > 100000)
+		res = 100;
+
+	vertex_refinement_steps = p.vertex_refinement_steps;
+
+	if(vertex_refinement_steps < 0 || vertex_refinement_steps > 1000)
+		vertex_refinement_steps = 0;
+
+	shell_thickness = p.shell_thickness;
+
+	if(shell_thickness < 0)
+		shell_thickness = 0;
+	else if(shell_thickness > 1)
+		shell_thickness = 1;
+
+	grid_min = p.grid_min;
+	grid_max = p.grid_max;
+
+	if(grid_min == grid_max)
+	{
+		grid_min = -1.5;
+		grid_max = 1.5;
+	}
+	else if(grid_min > grid_max)
+	{
+		float min = grid_max;
+		float max = grid_min;
+
+		grid_min = min;
+		grid_max = max;
+	}
+
+	// Set step size now that we have res and grid extent parameters
+	step_size = (grid_max - grid_min) / (res - 1);
+
+	// A time budget may lower these during a run; each run starts over from the configured values.
+	configured_res = res;
+	configured_vertex_refinement_steps = vertex_refinement_steps;
+
+	max_iterations = p.max_iterations;
+	threshold = p.threshold;
+	z_w = p.z_w;
+	C = p.C;
+	equation_text = p.equation_text;
+
+	string error_string;
+
+	if(false == setup_equation_text(equation_text, error_string))
+	{
+		status_string = "Error parsing formula -- " + error_string;
+		return false;
+	}
+
+	addsub_blocks.clear();
+
+	for(size_t i = 0; i < p.addsub_blocks.size(); i++)
+	{
+		addsub_block b = p.addsub_blocks[i];
+
 		if(0 > b.start_x)
 			b.start_x = 0;
 		else if(1 < b.start_x)
@@ -374,7 +547,6 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 			b.start_z = b.end_z;
 			b.end_z = temp;
 		}
-
 		addsub_blocks.push_back(b);
 	}
 
@@ -384,33 +556,63 @@ bool quaternion_julia_set::load_configuration_from_file(const char *file_name)
 	return true;
 }
 
-bool quaternion_julia_set::generate_and_write_isosurface_to_binary_stl_file(const char *file_name)
+static bool has_file_extension(const string &file_name, const string &extension)
 {
-	if(false == parameters_configured)
-	{
-		status_string = "The quaternion Julia set parameters have not yet been configured.";
+	if(file_name.size() < extension.size())
 		return false;
-	}
-
-	time_t start_time;
-	time(&start_time);
 
-	vector<bool> fractal_set;
+	return lower_string(file_name.substr(file_name.size() - extension.size())) == extension;
+}
 
-	if(false == generate_fractal_set(fractal_set))
+bool quaternion_julia_set::generate_voxel_set(voxel_grid &fractal_set, const char *const file_name)
+{
+	if(false == report_progress("generate set", 0))
 		return false;
 
-	cout << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+	// If the time budget cannot cover the set at this resolution, start over at a lower one.
+	while(true)
+	{
+		if(false == allocate_grid(fractal_set, file_name))
+			return false;
+
+		bool generated = false;
+
+		if(true == progressive)
+			generated = generate_fractal_set_progressively(fractal_set, file_name);
+		else
+			generated = generate_fractal_set(fractal_set);
+
+		if(true == generated)
+			break;
+
+		if(false == reduced_res_for_budget)
+			return false;
+
+		reduced_res_for_budget = false;
+	}
+
+	record_stage_time("generate set");
+	log_output << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+
+	if(false == report_progress("generate set", 1))
+		return false;
 
 	// Hollow out the set if desired.
 	if(0 < shell_thickness)
 	{
-		cout << "Finding surface" << endl;
+		log_output << "Finding surface" << endl;
+
+		if(false == report_progress("shell", 0))
+			return false;
+
+		voxel_grid surface;
+
+		if(false == allocate_grid(surface, file_name))
+			return false;
 
-		vector<bool> surface;
 		get_surface_set(fractal_set, surface);
 
-		cout << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+		log_output << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
 
 		// Get shell thickness in terms of integer units with respect to res -- use rounding.
 		size_t shell_thickness_int = static_cast<size_t>(floorf(0.5f + static_cast<float>(res) * shell_thickness));
@@ -423,14 +625,19 @@ bool quaternion_julia_set::generate_and_write_isosurface_to_binary_stl_file(cons
 		// Shell is already 1 unit thick; thicken further if needed.
 		for(size_t i = 1; i < shell_thickness_int; i++)
 		{
-			cout << "Thickening shell (pass " << i << " of " << shell_thickness_int - 1 << ')' << endl;
-			thicken_shell(fractal_set, surface);
+			log_output << "Thickening shell (pass " << i << " of " << shell_thickness_int - 1 << ')' << endl;
+			if(false == thicken_shell(fractal_set, surface, file_name, i - 1, shell_thickness_int - 1))
+				return false;
 		}
 
 		// Assign the shell to the set.
 		surface.swap(fractal_set);
 
-		cout << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+		record_stage_time("shell");
+		log_output << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+
+		if(false == report_progress("shell", 1))
+			return false;
 	}
 
 	// Add / subtract blocks from the set.
@@ -440,129 +647,488 @@ bool quaternion_julia_set::generate_and_write_isosurface_to_binary_stl_file(cons
 		{
 			if(true == addsub_blocks[i].additive)
 			{
-				cout << "Adding block " << i + 1 << " of " << addsub_blocks.size() << endl;
+				log_output << "Adding block " << i + 1 << " of " << addsub_blocks.size() << endl;
 				add_to_set(fractal_set, addsub_blocks[i]);
 			}
 			else
 			{
-				cout << "Subtracting block " << i + 1 << " of " << addsub_blocks.size() << endl;
+				log_output << "Subtracting block " << i + 1 << " of " << addsub_blocks.size() << endl;
 				subtract_from_set(fractal_set, addsub_blocks[i]);
 			}
 		}
 
-		cout << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+		record_stage_time("blocks");
+		log_output << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
 	}
 
-	cout << "Converting set to isosurface" << endl;
-	indexed_mesh m;
-
-	if(false == tesselate_set(fractal_set, m))
-		return false;
+	// If half of the time budget is already gone, skip vertex refinement, which dominates tesselation time.
+	// This is decided once for the whole tesselation, so that neighbouring slabs agree on their shared vertices.
+	if(0 < time_budget_seconds && 0 < vertex_refinement_steps && get_run_seconds() > 0.5*time_budget_seconds)
+	{
+		log_output << "Time budget: skipping vertex refinement" << endl;
+		vertex_refinement_steps = 0;
+	}
 
-	cout << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+	return true;
+}
 
-	if(0 == m.get_triangle_count())
+bool quaternion_julia_set::generate_isosurface(indexed_mesh &m)
+{
+	if(false == parameters_configured)
 	{
-		cout << "No triangles generated -- aborting early." << endl;
-		status_string = "OK";
-		return true;
+		status_string = "The quaternion Julia set parameters have not yet been configured.";
+		return false;
 	}
 
-	cout << "Analyzing mesh for problem edges (cracks, holes) and degenerate triangles" << endl;
+	begin_run();
 
-	size_t problem_edge_count = m.get_problem_edge_count();
-	size_t degenerate_triangle_count = m.get_degenerate_triangle_count();
+	voxel_grid fractal_set;
 
-	if(0 == problem_edge_count && 0 == degenerate_triangle_count)
-	{
-		cout << "No problems detected." << endl;
-	}
-	else
-	{
-		cout << problem_edge_count << " problem edges found" << endl;
-		cout << degenerate_triangle_count << " degenerate triangles found" << endl;
-		cout << "Did you go a little too hardcore on the vertex refinement steps / grid resolution options?" << endl;
-		cout << "If not, try using netfabb or MeshLab to fix the mesh." << endl;
-	}
+	if(false == generate_voxel_set(fractal_set, ""))
+		return false;
 
-	cout << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+	log_output << "Converting set to isosurface" << endl;
+
+	if(false == report_progress("tesselate", 0))
+		return false;
 
-	cout << "Mesh information:" << endl;
-	cout << "Mesh x extent:     " << m.get_x_extent() << " units" << endl;
-	cout << "Mesh y extent:     " << m.get_y_extent() << " units" << endl;
-	cout << "Mesh z extent:     " << m.get_z_extent() << " units" << endl;
-	cout << "Mesh surface area: " << m.get_area()     << " units^2" << endl;
-	cout << "Mesh volume:       " << m.get_volume()   << " units^3" << endl;
-	cout << "File name:         " << file_name << endl;
-	cout << "Triangles:         " << m.get_triangle_count() << endl;
-	cout << "Vertices:          " << m.get_triangle_count()*3 << " (of which " << m.get_vertex_count() << " are unique)" << endl;
+	if(false == tesselate_set(fractal_set, m, "tesselate"))
+		return false;
 
-	if(false == m.save_to_binary_stereo_lithography_file(file_name))
+	if(false == m.is_finalized())
 	{
-		status_string = "Could not save to binary Stereo Lithography file: ";
-		status_string += file_name;
+		status_string = m.get_status_string() + " Use -stream to write it as it is made.";
 		return false;
 	}
 
-	cout << "Total elapsed time: " << time(0) - start_time << " seconds." << endl;
+	record_stage_time("tesselate");
+
+	if(false == report_progress("tesselate", 1))
+		return false;
 
 	status_string = "OK";
 	return true;
 }
 
-string quaternion_julia_set::get_blocks_string(void)
+bool quaternion_julia_set::generate_and_write_isosurface_to_binary_stl_file(const char *file_name)
 {
-	if(0 == addsub_blocks.size())
-		return "None";
-
-	ostringstream oss;
-
-	for(size_t i = 0; i < addsub_blocks.size(); i++)
+	if(false == parameters_configured)
 	{
-		if(true == addsub_blocks[i].additive)
-			oss << "addblock, ";
-		else
-			oss << "subblock, ";
+		status_string = "The quaternion Julia set parameters have not yet been configured.";
+		return false;
+	}
 
-		oss << addsub_blocks[i].start_x << ", ";
-		oss << addsub_blocks[i].end_x << ", ";
-		oss << addsub_blocks[i].start_y << ", ";
-		oss << addsub_blocks[i].end_y << ", ";
-		oss << addsub_blocks[i].start_z << ", ";
-		oss << addsub_blocks[i].end_z;
-		
-		if(i < addsub_blocks.size() - 1)
-			oss << endl;
+	// Check this before generating the set, which can take hours at large resolutions.
+	if(true == stream_output && (has_file_extension(file_name, ".ply") || has_file_extension(file_name, ".obj") || has_file_extension(file_name, ".glb") || has_file_extension(file_name, ".qjm")))
+	{
+		status_string = "Streaming output only supports binary Stereo Lithography files.";
+		return false;
 	}
 
-	return oss.str();
-}
+	begin_run();
 
-bool quaternion_julia_set::setup_equation_text(const string &src_equation_text, string &error_string)
-{
-	if(eqparser.setup(src_equation_text, error_string, C))
-		return true;
-	else
-		return false;
-}
+	voxel_grid fractal_set;
 
-bool quaternion_julia_set::initialize_fragment_shader(const string &fragment_shader_code, GLint &shader)
-{
-	shader = 0;
+	if(false == generate_voxel_set(fractal_set, file_name))
+		return false;
 
-	if(true == opengl_init_ok)
+	// Binary STL is not indexed, so the triangles can go straight to disk,
+	// skipping the welding, adjacency and validation steps.
+	if(true == stream_output)
 	{
-		// Compile shader.
-		const char *cch = 0;
-		GLint status = GL_FALSE;
-		GLint frag = glCreateShader(GL_FRAGMENT_SHADER);
+		log_output << "Converting set to isosurface, streaming to " << file_name << endl;
 
-		glShaderSource(frag, 1, &(cch = fragment_shader_code.c_str()), 0);
-		glCompileShader(frag);
-		glGetShaderiv(frag, GL_COMPILE_STATUS, &status);
+		if(false == report_progress("tesselate and write", 0))
+			return false;
 
-		if(GL_FALSE == status)
-		{
+		stereo_lithography_stream sls(file_name);
+
+		if(false == tesselate_set(fractal_set, sls, "tesselate and write"))
+			return false;
+
+		if(false == sls.is_ok())
+		{
+			status_string = "Could not save to binary Stereo Lithography file: ";
+			status_string += file_name;
+			return false;
+		}
+
+		record_stage_time("tesselate and write");
+
+		if(false == report_progress("tesselate and write", 1))
+			return false;
+
+		log_output << "Triangles:         " << sls.get_triangle_count() << endl;
+		log_output << "Total elapsed time: " << time(0) - start_time << " seconds." << endl;
+
+		status_string = "OK";
+		return true;
+	}
+
+	log_output << "Converting set to isosurface" << endl;
+
+	if(false == report_progress("tesselate", 0))
+		return false;
+
+	indexed_mesh m;
+
+	if(false == tesselate_set(fractal_set, m, "tesselate"))
+		return false;
+
+	if(false == m.is_finalized())
+	{
+		status_string = m.get_status_string() + " Use -stream to write it as it is made.";
+		return false;
+	}
+
+	record_stage_time("tesselate");
+	log_output << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+
+	if(0 == m.get_triangle_count())
+	{
+		log_output << "No triangles generated -- aborting early." << endl;
+		status_string = "OK";
+		return true;
+	}
+
+	// Marching tetrahedra has no ambiguous cases, so its mesh is always closed and manifold,
+	// and there are no cracks or holes to look for.
+	if(MARCHING_TETRAHEDRA == method)
+	{
+		log_output << "Skipping mesh validation; marching tetrahedra always makes a closed, manifold mesh.\n" << endl;
+	}
+	else
+	{
+		if(false == report_progress("validate", 0))
+			return false;
+
+		log_output << "Analyzing mesh for problem edges (cracks, holes) and degenerate triangles" << endl;
+
+		mesh_validation_report report;
+		m.validate(report);
+
+		if(0 == report.problem_edge_count && 0 == report.non_manifold_vertex_count && 0 == report.degenerate_triangle_count)
+		{
+			log_output << "No problems detected." << endl;
+		}
+		else
+		{
+			log_output << report.problem_edge_count << " problem edges found (" << report.boundary_edge_count << " boundary, " << report.non_manifold_edge_count << " non-manifold)" << endl;
+			log_output << report.boundary_loop_count << " boundary loops found" << endl;
+			log_output << report.non_manifold_vertex_count << " non-manifold vertices found" << endl;
+			log_output << report.degenerate_triangle_count << " degenerate triangles found" << endl;
+			log_output << "Did you go a little too hardcore on the vertex refinement steps / grid resolution options?" << endl;
+			log_output << "If not, try using netfabb or MeshLab to fix the mesh." << endl;
+		}
+
+		record_stage_time("validate");
+		log_output << "Elapsed time so far: " << time(0) - start_time << " seconds.\n" << endl;
+
+		if(false == report_progress("validate", 1))
+			return false;
+	}
+
+	mesh_statistics stats;
+	m.get_statistics(stats);
+
+	log_output << "Mesh information:" << endl;
+	log_output << "Mesh x extent:     " << stats.max_corner.x - stats.min_corner.x << " units" << endl;
+	log_output << "Mesh y extent:     " << stats.max_corner.y - stats.min_corner.y << " units" << endl;
+	log_output << "Mesh z extent:     " << stats.max_corner.z - stats.min_corner.z << " units" << endl;
+	log_output << "Mesh surface area: " << stats.area   << " units^2" << endl;
+	log_output << "Mesh volume:       " << stats.volume << " units^3" << endl;
+	log_output << "Normal closure:    " << stats.normal_closure << " (0 for a closed, consistently oriented mesh)" << endl;
+	log_output << "File name:         " << file_name << endl;
+	log_output << "Triangles:         " << m.get_triangle_count() << endl;
+	log_output << "Vertices:          " << m.get_triangle_count()*3 << " (of which " << m.get_vertex_count() << " are unique)" << endl;
+
+	if(false == report_progress("save", 0))
+		return false;
+
+	// The output format follows the file name extension; anything unrecognized is written as binary STL.
+	bool saved = false;
+
+	if(has_file_extension(file_name, ".ply"))
+	{
+		saved = m.save_to_binary_polygon_file(file_name);
+		status_string = "Could not save to binary Polygon File Format file: ";
+	}
+	else if(has_file_extension(file_name, ".obj"))
+	{
+		saved = m.save_to_wavefront_obj_file(file_name);
+		status_string = "Could not save to Wavefront OBJ file: ";
+	}
+	else if(has_file_extension(file_name, ".glb"))
+	{
+		saved = m.save_to_gltf_binary_file(file_name);
+		status_string = "Could not save to binary glTF file: ";
+	}
+	else if(has_file_extension(file_name, ".qjm"))
+	{
+		saved = m.save_to_quantized_mesh_file(file_name, grid_min, step_size, res);
+		status_string = "Could not save to quantized mesh file: ";
+
+		// On request, decode the file again and compare it with the mesh, as a round trip test of the format.
+		// This holds a second copy of the mesh, so it is not done by default.
+		if(true == saved && true == verify_output)
+		{
+			log_output << "Checking that the quantized mesh file reads back" << endl;
+
+			saved = m.check_quantized_mesh_file(file_name, grid_min, step_size, res);
+			status_string = "Quantized mesh file did not read back within the quantization error: ";
+		}
+	}
+	else
+	{
+		log_output << "Writing " << stl_per_triangle_data_size*m.get_triangle_count() / 1048576 << " MB of data to disk" << endl;
+		saved = m.save_to_binary_stereo_lithography_file(file_name);
+		status_string = "Could not save to binary Stereo Lithography file: ";
+	}
+
+	if(false == saved)
+	{
+		status_string += file_name;
+		return false;
+	}
+
+	record_stage_time("save");
+	log_output << "Total elapsed time: " << time(0) - start_time << " seconds." << endl;
+
+	if(false == report_progress("save", 1))
+		return false;
+
+	status_string = "OK";
+	return true;
+}
+
+bool quaternion_julia_set_run_options::parse_option(const vector<string> &args, size_t &i)
+{
+	string arg = lower_string(args[i]);
+
+	// Accept -name, /name and name alike.
+	if(0 < arg.size() && ('-' == arg[0] || '/' == arg[0]))
+		arg = arg.substr(1);
+
+	if(arg == "stream")
+		stream_output = true;
+	else if(arg == "mmap")
+		memory_mapped_grids = true;
+	else if(arg == "periodicity")
+		periodicity_checking = true;
+	else if(arg == "progressive")
+		progressive = true;
+	else if(arg == "verify")
+		verify_output = true;
+	else if(arg == "watertight")
+		method = MARCHING_TETRAHEDRA;
+	else if(arg == "surfacenets")
+		method = SURFACE_NETS;
+	else if(arg == "timebudget" && i + 1 < args.size() && is_real_number(args[i + 1]))
+		istringstream(args[++i]) >> time_budget_seconds;
+	else
+		return false;
+
+	return true;
+}
+
+void quaternion_julia_set::set_run_options(const quaternion_julia_set_run_options &options)
+{
+	set_stream_output(options.stream_output);
+	set_memory_mapped_grids(options.memory_mapped_grids);
+	set_periodicity_epsilon(options.periodicity_checking ? 1e-5f : 0);
+	set_progressive(options.progressive);
+	set_verify_output(options.verify_output);
+	set_tesselation_method(options.method);
+	set_time_budget(options.time_budget_seconds);
+}
+
+size_t quaternion_julia_set::get_estimated_grid_bytes(void)
+{
+	// One bit per voxel, rounded up to whole bricks.
+	const size_t bricks_per_axis = (res + voxel_brick_size - 1) / voxel_brick_size;
+	const size_t grid_bytes = bricks_per_axis*bricks_per_axis*bricks_per_axis*voxel_brick_size*voxel_brick_size*voxel_brick_size/8;
+
+	// The set itself, plus the surface and scratch grids used when hollowing it out,
+	// plus the known-value grid used by progressive evaluation.
+	size_t grid_count = 1;
+
+	if(0 < shell_thickness)
+		grid_count += 2;
+
+	if(true == progressive)
+		grid_count++;
+
+	return grid_count*grid_bytes;
+}
+
+size_t quaternion_julia_set::get_estimated_mesh_bytes(void)
+{
+	// Streamed triangles go straight to disk.
+	if(true == stream_output)
+		return 0;
+
+	// The sample sets make about 11 to 14 marching cubes triangles per res^2 of each surface,
+	// so allow 16. Hollowing the set out adds the inner surface.
+	size_t triangle_count = 16*res*res;
+
+	if(0 < shell_thickness)
+		triangle_count *= 2;
+
+	if(MARCHING_TETRAHEDRA == method)
+		triangle_count *= 3;
+
+	// The welded mesh measures about 120 bytes per triangle at its peak: the triangles, the vertices,
+	// the vertex set used while welding, and the adjacency lists.
+	return 128*triangle_count;
+}
+
+void quaternion_julia_set::set_log_stream(ostream *const dest)
+{
+	// A stream buffer of 0 makes every write a no-op.
+	if(0 == dest)
+		log_output.rdbuf(0);
+	else
+		log_output.rdbuf(dest->rdbuf());
+}
+
+bool quaternion_julia_set::report_progress(const char *const stage_name, const float fraction)
+{
+	if( (0 != cancel_token && true == cancel_token->is_cancelled()) ||
+		(0 != progress_function && false == progress_function(stage_name, fraction, progress_user_data)) )
+	{
+		status_string = "Cancelled.";
+		return false;
+	}
+
+	return true;
+}
+
+void quaternion_julia_set::begin_run(void)
+{
+	time(&start_time);
+
+	run_start_time = std::chrono::steady_clock::now();
+	stage_start_time = run_start_time;
+	stage_timings.clear();
+
+	res = configured_res;
+	vertex_refinement_steps = configured_vertex_refinement_steps;
+	step_size = (grid_max - grid_min) / (res - 1);
+	reduced_res_for_budget = false;
+}
+
+double quaternion_julia_set::get_run_seconds(void)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start_time).count();
+}
+
+bool quaternion_julia_set::check_set_generation_budget(const std::chrono::steady_clock::time_point &pass_start_time, const size_t slabs_done)
+{
+	// Leave half of the budget for the shell, tesselation and output.
+	// Wait for a few slabs so that the estimate is not thrown off by start-up costs.
+	if(0 >= time_budget_seconds || 4 > slabs_done || 16 >= res)
+		return true;
+
+	const double pass_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start_time).count();
+
+	return check_projected_set_generation_time(pass_seconds, pass_seconds * res / slabs_done);
+}
+
+bool quaternion_julia_set::check_projected_set_generation_time(const double pass_seconds, const double projected_seconds)
+{
+	const double run_seconds = get_run_seconds();
+	const double available_seconds = 0.5*time_budget_seconds - (run_seconds - pass_seconds);
+
+	if(projected_seconds <= 1.1*available_seconds)
+		return true;
+
+	// The work grows with the cube of the resolution, and the time spent on this pass is lost.
+	const double remaining_seconds = 0.5*time_budget_seconds - run_seconds;
+	size_t reduced_res = 16;
+
+	if(0 < remaining_seconds)
+		reduced_res = static_cast<size_t>(res * pow(remaining_seconds / projected_seconds, 1.0/3.0));
+
+	if(16 > reduced_res)
+		reduced_res = 16;
+
+	if(reduced_res >= res)
+		return true;
+
+	log_output << "Time budget: reducing grid resolution from " << res << " to " << reduced_res << endl;
+
+	res = reduced_res;
+	step_size = (grid_max - grid_min) / (res - 1);
+	reduced_res_for_budget = true;
+
+	status_string = "Grid resolution reduced to fit the time budget.";
+	return false;
+}
+
+void quaternion_julia_set::record_stage_time(const char *const stage_name)
+{
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	stage_timings.push_back(pair<string, double>(stage_name, std::chrono::duration<double>(now - stage_start_time).count()));
+	stage_start_time = now;
+}
+
+string quaternion_julia_set::get_blocks_string(void)
+{
+	if(0 == addsub_blocks.size())
+		return "None";
+
+	ostringstream oss;
+
+	for(size_t i = 0; i < addsub_blocks.size(); i++)
+	{
+		if(true == addsub_blocks[i].additive)
+			oss << "addblock, ";
+		else
+			oss << "subblock, ";
+
+		oss << addsub_blocks[i].start_x << ", ";
+		oss << addsub_blocks[i].end_x << ", ";
+		oss << addsub_blocks[i].start_y << ", ";
+		oss << addsub_blocks[i].end_y << ", ";
+		oss << addsub_blocks[i].start_z << ", ";
+		oss << addsub_blocks[i].end_z;
+		
+		if(i < addsub_blocks.size() - 1)
+			oss << endl;
+	}
+
+	return oss.str();
+}
+
+bool quaternion_julia_set::setup_equation_text(const string &src_equation_text, string &error_string)
+{
+	if(eqparser.setup(src_equation_text, error_string, C))
+		return true;
+	else
+		return false;
+}
+
+bool quaternion_julia_set::initialize_fragment_shader(const string &fragment_shader_code, GLint &shader)
+{
+	shader = 0;
+
+	if(true == opengl_init_ok)
+	{
+		// Reuse a previously linked program if the driver can hand one back.
+		if(GLEW_ARB_get_program_binary && true == load_program_binary(fragment_shader_code, shader))
+			return true;
+
+		// Compile shader.
+		const char *cch = 0;
+		GLint status = GL_FALSE;
+		GLint frag = glCreateShader(GL_FRAGMENT_SHADER);
+
+		glShaderSource(frag, 1, &(cch = fragment_shader_code.c_str()), 0);
+		glCompileShader(frag);
+		glGetShaderiv(frag, GL_COMPILE_STATUS, &status);
+
+		if(GL_FALSE == status)
+		{
 			status_string = "Fragment shader compile error.\n";
 			vector<GLchar> buf(4096, '\0');
 			glGetShaderInfoLog(frag, 4095, 0, &buf[0]);
@@ -580,6 +1146,10 @@ bool quaternion_julia_set::initialize_fragment_shader(const string &fragment_sha
 		// Link to get final shader.
 		shader = glCreateProgram();
 		glAttachShader(shader, frag);
+
+		if(GLEW_ARB_get_program_binary)
+			glProgramParameteri(shader, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 		glLinkProgram(shader);
 		glGetProgramiv(shader, GL_LINK_STATUS, &status);
 
@@ -595,44 +1165,213 @@ bool quaternion_julia_set::initialize_fragment_shader(const string &fragment_sha
 
 			status_string += '\n';
 
-			glDetachShader(shader, frag);
-			glDeleteShader(frag);
-			return false;
-		}
+			glDetachShader(shader, frag);
+			glDeleteShader(frag);
+			return false;
+		}
+
+		// Cleanup.
+		glDetachShader(shader, frag);
+		glDeleteShader(frag);
+
+		if(GLEW_ARB_get_program_binary)
+			store_program_binary(fragment_shader_code, shader);
+
+		return true;
+	}
+
+	return false;
+}
+
+bool quaternion_julia_set::load_program_binary(const string &fragment_shader_code, GLint &shader)
+{
+	size_t index = program_binaries.size();
+
+	for(size_t i = 0; i < program_binaries.size(); i++)
+	{
+		if(program_binaries[i].fragment_shader_code == fragment_shader_code)
+		{
+			// Keep the cache in order of last use, so that the least recently used entry is the one dropped.
+			rotate(program_binaries.begin() + i, program_binaries.begin() + i + 1, program_binaries.end());
+			index = program_binaries.size() - 1;
+			break;
+		}
+	}
+
+	// Not in memory; try the disk cache.
+	if(index == program_binaries.size() && "" != shader_cache_directory)
+	{
+		ifstream in(get_program_binary_file_name(fragment_shader_code).c_str(), ios_base::binary);
+
+		if(in.fail())
+			return false;
+
+		in.seekg(0, ios_base::end);
+		const uint64_t file_size = static_cast<uint64_t>(in.tellg());
+		in.seekg(0, ios_base::beg);
+
+		const uint64_t header_size = sizeof(uint32_t) + 2*sizeof(uint64_t);
+
+		program_binary pb;
+		uint32_t format = 0;
+		uint64_t code_length = 0, binary_length = 0;
+
+		in.read(reinterpret_cast<char *>(&format), sizeof(format));
+		in.read(reinterpret_cast<char *>(&code_length), sizeof(code_length));
+
+		// Check the lengths against the file before allocating anything, so that a corrupt file can not ask for more.
+		if(in.fail() || file_size < header_size || code_length != fragment_shader_code.length() || code_length > file_size - header_size)
+			return false;
+
+		pb.fragment_shader_code.resize(static_cast<size_t>(code_length));
+		in.read(&pb.fragment_shader_code[0], code_length);
+		in.read(reinterpret_cast<char *>(&binary_length), sizeof(binary_length));
+
+		// Guard against a hash collision or a truncated file.
+		if(in.fail() || pb.fragment_shader_code != fragment_shader_code || 0 == binary_length || binary_length != file_size - header_size - code_length)
+			return false;
+
+		pb.format = format;
+		pb.binary.resize(static_cast<size_t>(binary_length));
+		in.read(&pb.binary[0], binary_length);
+
+		if(in.fail())
+			return false;
+
+		cache_program_binary(pb);
+		index = program_binaries.size() - 1;
+	}
+
+	if(index == program_binaries.size())
+		return false;
+
+	const program_binary &pb = program_binaries[index];
+
+	shader = glCreateProgram();
+	glProgramBinary(shader, pb.format, &pb.binary[0], static_cast<GLsizei>(pb.binary.size()));
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(shader, GL_LINK_STATUS, &status);
+
+	// The driver may refuse binaries from another driver version; fall back to compiling.
+	if(GL_FALSE == status)
+	{
+		glDeleteProgram(shader);
+		shader = 0;
+		program_binaries.erase(program_binaries.begin() + index);
+		return false;
+	}
+
+	return true;
+}
+
+void quaternion_julia_set::store_program_binary(const string &fragment_shader_code, const GLint shader)
+{
+	GLint binary_length = 0;
+	glGetProgramiv(shader, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+
+	if(0 >= binary_length)
+		return;
+
+	program_binary pb;
+	pb.fragment_shader_code = fragment_shader_code;
+	pb.binary.resize(binary_length);
+	glGetProgramBinary(shader, binary_length, 0, &pb.format, &pb.binary[0]);
+
+	cache_program_binary(pb);
+
+	if("" == shader_cache_directory)
+		return;
+
+	ofstream out(get_program_binary_file_name(fragment_shader_code).c_str(), ios_base::binary);
+
+	if(out.fail())
+		return;
+
+	// Fixed-width lengths, so that the file reads the same whatever the size of size_t.
+	const uint32_t format = pb.format;
+	const uint64_t code_length = fragment_shader_code.length();
+	const uint64_t binary_size = pb.binary.size();
+
+	out.write(reinterpret_cast<const char *>(&format), sizeof(format));
+	out.write(reinterpret_cast<const char *>(&code_length), sizeof(code_length));
+	out.write(fragment_shader_code.c_str(), code_length);
+	out.write(reinterpret_cast<const char *>(&binary_size), sizeof(binary_size));
+	out.write(&pb.binary[0], binary_size);
+}
+
+void quaternion_julia_set::cache_program_binary(const program_binary &pb)
+{
+	// Drop the least recently used entry once full.
+	if(program_binaries.size() >= max_program_binary_cache_size)
+		program_binaries.erase(program_binaries.begin());
+
+	program_binaries.push_back(pb);
+}
+
+string quaternion_julia_set::get_program_binary_file_name(const string &fragment_shader_code)
+{
+	// 64-bit FNV-1a hash of the shader source.
+	unsigned long long int hash = 14695981039346656037ULL;
+
+	for(size_t i = 0; i < fragment_shader_code.length(); i++)
+	{
+		hash ^= static_cast<unsigned char>(fragment_shader_code[i]);
+		hash *= 1099511628211ULL;
+	}
+
+	ostringstream oss;
+	oss << shader_cache_directory << "/qjs_" << std::hex << hash << ".bin";
+
+	return oss.str();
+}
+
+bool quaternion_julia_set::allocate_grid(voxel_grid &grid, const char *const file_name, const size_t grid_res)
+{
+	string backing_file_name;
+
+	// Keep memory-mapped grids next to the output file.
+	if(true == memory_mapped_grids && 0 != file_name && '\0' != file_name[0])
+	{
+		ostringstream oss;
+		oss << file_name << ".grid" << grid_backing_file_count++ << ".tmp";
+		backing_file_name = oss.str();
+	}
+
+	if(false == grid.allocate(0 == grid_res ? res : grid_res, backing_file_name))
+	{
+		status_string = "Could not allocate voxel grid";
 
-		// Cleanup.
-		glDetachShader(shader, frag);
-		glDeleteShader(frag);
+		if("" != backing_file_name)
+			status_string += " backing file " + backing_file_name;
 
-		return true;
+		return false;
 	}
 
-	return false;
+	return true;
 }
 
-bool quaternion_julia_set::generate_fractal_set(vector<bool> &fractal_set)
+bool quaternion_julia_set::generate_fractal_set(voxel_grid &fractal_set)
 {
-	fractal_set.resize(res*res*res);
-
 	GLint shader_handle = 0;
 	GLuint fbo_handle = 0;
 	GLuint tex_fbo_handle = 0;
-	GLuint tex_in_handle = 0;
 	GLuint tex_out_handle = 0;
-	const GLint tex_in_internal_format = GL_RGB32F_ARB;
-	const GLint tex_in_format = GL_RGB;
-	const GLint tex_out_internal_format = GL_RGB32F_ARB; // Note: We only need one channel, but alpha and luminance aren't cross-platform compatible ...
-	const GLint tex_out_format = GL_RGB;
-	const GLint var_type = GL_FLOAT;
-	const GLint tex_size_x = res;
-	const GLint tex_size_y = res;
+	const GLint tex_out_internal_format = GL_RGBA8; // The shader writes a 0 / 1 mask; RGBA8 is renderable everywhere, and only the red channel is read back.
+	const GLint tex_out_format = GL_RGBA;
+	const GLint var_type = GL_UNSIGNED_BYTE;
 	GLint max_tex_size = 0;
 
+	// Slabs are rendered as res x res tiles of an atlas, filled row by row, so that one draw
+	// evaluates many slabs. The CPU path works one slab at a time.
+	size_t tile_columns = 1;
+	size_t tile_rows = 1;
+
 	if(true == opengl_init_ok)
 	{
 		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_tex_size);
 
-		if(max_tex_size < tex_size_x || max_tex_size < tex_size_y)
+		if(static_cast<size_t>(max_tex_size) < res)
 		{
 			ostringstream oss;
 			oss << "GPU max texture size (" << max_tex_size << ") is not large enough.";
@@ -641,22 +1380,34 @@ bool quaternion_julia_set::generate_fractal_set(vector<bool> &fractal_set)
 			return false;
 		}
 
-		ofstream of("main_shader.txt");
-		of << eqparser.emit_fragment_shader_code() << "\n// Equation text: " << equation_text << endl;
-		of.close();
+		// Keep the atlas, and the two readback buffers, to a bounded size.
+		const size_t max_tiles = std::max(static_cast<size_t>(1), max_atlas_texels / (res*res));
+		const size_t tiles_per_side = max_tex_size / res;
+
+		tile_columns = std::min(std::min(tiles_per_side, res), max_tiles);
+		tile_rows = std::min(std::min(tiles_per_side, (std::min(res, max_tiles) + tile_columns - 1) / tile_columns), max_tiles / tile_columns);
+	}
+
+	const size_t slabs_per_batch = tile_columns*tile_rows;
+	const GLint tex_size_x = static_cast<GLint>(tile_columns*res);
+	const GLint tex_size_y = static_cast<GLint>(tile_rows*res);
+
+	if(true == opengl_init_ok)
+	{
+
+		if(true == write_shader_files)
+		{
+			ofstream of("main_shader.txt");
+			of << eqparser.emit_fragment_shader_code() << "\n// Equation text: " << equation_text << endl;
+			of.close();
+		}
 
 		// Load and compile shader.
 		if(false == initialize_fragment_shader(eqparser.emit_fragment_shader_code(), shader_handle))
 			return false;
 
 		// Allocate OpenGL objects.
-		glGenTextures(1, &tex_in_handle);
-		glBindTexture(GL_TEXTURE_2D, tex_in_handle);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
+		// The shader works out each grid point from its pixel position, so there is no input texture.
 		glGenTextures(1, &tex_out_handle);
 		glBindTexture(GL_TEXTURE_2D, tex_out_handle);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -679,105 +1430,449 @@ bool quaternion_julia_set::generate_fractal_set(vector<bool> &fractal_set)
 
 		// Initial setup for "drawing".
 		glUseProgram(shader_handle);
-		glUniform1i(glGetUniformLocation(shader_handle, "z_xyz"), 0); // Use texture 0.
+		glUniform1f(glGetUniformLocation(shader_handle, "grid_min"), grid_min);
+		glUniform1f(glGetUniformLocation(shader_handle, "step_size"), step_size);
 		glUniform1f(glGetUniformLocation(shader_handle, "z_w"), z_w);
 		glUniform4f(glGetUniformLocation(shader_handle, "c"), C.x, C.y, C.z, C.w);
 		glUniform1i(glGetUniformLocation(shader_handle, "max_iterations"), max_iterations);
 		glUniform1f(glGetUniformLocation(shader_handle, "threshold"), threshold);
+		glUniform1f(glGetUniformLocation(shader_handle, "periodicity_epsilon"), eqparser.get_periodicity_epsilon());
+		glUniform1f(glGetUniformLocation(shader_handle, "tile_size"), static_cast<float>(res));
+		glUniform1f(glGetUniformLocation(shader_handle, "tile_columns"), static_cast<float>(tile_columns));
 	}
 
-	vector<float> input(res*res*3, 0); // one float per channel, three channels (RGB)
-	vector<float> output(res*res*3, 0); // one float per channel, three channels (RGB). Note: We only need one channel, but alpha and luminance aren't cross-platform compatible ...
+	const GLint first_slab_location = (true == opengl_init_ok) ? glGetUniformLocation(shader_handle, "first_slab") : -1;
 
-	for(size_t z = 0; z < res; z++)
-	{
-		cout << "Calculating xy-plane " << z + 1 << " of " << res << endl;
+	// One byte per grid point, non-zero if the point is in the set.
+	vector<unsigned char> mask(res*res, 0);
+
+	// With pixel buffer objects, the readback of one batch of slabs runs while the next batch is being drawn,
+	// and a batch is only converted to bits after that.
+	const bool use_pixel_buffers = (true == opengl_init_ok && GLEW_ARB_pixel_buffer_object);
+	GLuint pbo_handles[2] = { 0, 0 };
 
-		// Set up input.
-		for(size_t x = 0; x < res; x++)
+	if(true == opengl_init_ok)
+	{
+		if(true == use_pixel_buffers)
 		{
-			for(size_t y = 0; y < res; y++)
+			glGenBuffers(2, pbo_handles);
+
+			for(size_t i = 0; i < 2; i++)
 			{
-				size_t input_index = 3*(x*res + y);
-				input[input_index + 0] = grid_min + x*step_size;
-				input[input_index + 1] = grid_min + y*step_size;
-				input[input_index + 2] = grid_min + z*step_size;
+				glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo_handles[i]);
+				glBufferData(GL_PIXEL_PACK_BUFFER_ARB, tex_size_x*tex_size_y, 0, GL_STREAM_READ);
 			}
+
+			glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
 		}
 
+		// Rows of the atlas are not padded.
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
+		glOrtho(0, 1, 0, 1, 0, 1);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+	}
+
+	const std::chrono::steady_clock::time_point pass_start_time = std::chrono::steady_clock::now();
+	bool completed = true;
+	size_t batch_index = 0;
+
+	for(size_t z = 0; z < res; z += slabs_per_batch, batch_index++)
+	{
+		const size_t slab_count = std::min(slabs_per_batch, res - z);
+
+		if(1 == slab_count)
+			log_output << "Calculating xy-plane " << z + 1 << " of " << res << endl;
+		else
+			log_output << "Calculating xy-planes " << z + 1 << " to " << z + slab_count << " of " << res << endl;
+
 		if(true == opengl_init_ok)
 		{
-			// Write to GPU memory.
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, tex_in_handle);
-			glTexImage2D(GL_TEXTURE_2D, 0, tex_in_internal_format, tex_size_x, tex_size_y, 0, tex_in_format, var_type, &input[0]);
+			// Only the rows of tiles in use are drawn and read back; this matters for the last batch.
+			const GLint batch_size_y = static_cast<GLint>(((slab_count + tile_columns - 1) / tile_columns)*res);
 
-			// Calculate by "drawing".
-			glMatrixMode(GL_PROJECTION);
-			glLoadIdentity();
-			glOrtho(0, 1, 0, 1, 0, 1);
-			glMatrixMode(GL_MODELVIEW);
-			glLoadIdentity();
-			glViewport(0, 0, tex_size_x, tex_size_y);
+			glViewport(0, 0, tex_size_x, batch_size_y);
+			glUniform1f(first_slab_location, static_cast<float>(z));
 
+			// Calculate by "drawing".
 			glBegin(GL_QUADS);
-				glTexCoord2f(0, 1);	glVertex2f(0, 1);
-				glTexCoord2f(0, 0);	glVertex2f(0, 0);
-				glTexCoord2f(1, 0);	glVertex2f(1, 0);
-				glTexCoord2f(1, 1);	glVertex2f(1, 1);
+				glVertex2f(0, 1);
+				glVertex2f(0, 0);
+				glVertex2f(1, 0);
+				glVertex2f(1, 1);
 			glEnd();
 
-			// Read from GPU memory.
-			glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
-			glReadPixels(0, 0, tex_size_x, tex_size_y, tex_out_format, var_type, &output[0]);
+			if(true == use_pixel_buffers)
+			{
+				// Start reading this batch back, then convert the previous one while that happens.
+				glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo_handles[batch_index % 2]);
+				glReadPixels(0, 0, tex_size_x, batch_size_y, GL_RED, GL_UNSIGNED_BYTE, 0);
+
+				if(0 < z)
+					store_atlas_masks_from_pixel_buffer(fractal_set, z - slabs_per_batch, slabs_per_batch, tile_columns, pbo_handles[(batch_index - 1) % 2]);
+
+				glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+			}
+			else
+			{
+				// Read from GPU memory.
+				if(mask.size() < static_cast<size_t>(tex_size_x*batch_size_y))
+					mask.resize(tex_size_x*batch_size_y);
+
+				glReadPixels(0, 0, tex_size_x, batch_size_y, GL_RED, GL_UNSIGNED_BYTE, &mask[0]);
+				store_atlas_masks(fractal_set, z, slab_count, tile_columns, &mask[0]);
+			}
 		}
 		else
 		{
 			for(size_t x = 0; x < res; x++)
-			{
 				for(size_t y = 0; y < res; y++)
-				{
-					size_t input_index = 3*(x*res + y);
-					size_t output_index = 3*(x*res + y);
+					mask[x*res + y] = (threshold > eqparser.iterate(quaternion(grid_min + x*step_size, grid_min + y*step_size, grid_min + z*step_size, z_w), max_iterations, threshold));
 
-					output[output_index] = eqparser.iterate(quaternion(input[input_index + 0], input[input_index + 1], input[input_index + 2], z_w), max_iterations, threshold);
-				}
-			}
+			store_slab_mask(fractal_set, z, &mask[0], res);
 		}
 
-		// Convert to bools.
-		for(size_t x = 0; x < res; x++)
+		if( false == report_progress("generate set", static_cast<float>(z + slab_count) / res) ||
+			false == check_set_generation_budget(pass_start_time, z + slab_count) )
 		{
-			for(size_t y = 0; y < res; y++)
-			{
-				size_t set_index = x*res*res + y*res + z;
-				size_t output_index = 3*(x*res + y);
-
-				// If in set.
-				if(threshold > output[output_index])
-					fractal_set[set_index] = true;
-				else
-					fractal_set[set_index] = false;
-			}
+			completed = false;
+			break;
 		}
 	} // End: for(size_t z = 0, ...
 
-	// Make border.
-	for(size_t x = 0; x < res; x++)
+	if(true == use_pixel_buffers)
+	{
+		// The last batch is still waiting in its pixel buffer.
+		if(true == completed)
+		{
+			const size_t last_z = ((res - 1) / slabs_per_batch)*slabs_per_batch;
+			store_atlas_masks_from_pixel_buffer(fractal_set, last_z, res - last_z, tile_columns, pbo_handles[(batch_index - 1) % 2]);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		glDeleteBuffers(2, pbo_handles);
+	}
+
+	if(true == opengl_init_ok)
+	{
+		// Cleanup OpenGL objects.
+		glDeleteTextures(1, &tex_out_handle);
+		glDeleteTextures(1, &tex_fbo_handle);
+		glDeleteFramebuffersEXT(1, &fbo_handle);
+		glUseProgram(0);
+		glDeleteProgram(shader_handle);
+	}
+
+	return completed;
+}
+
+void quaternion_julia_set::store_slab_mask(voxel_grid &fractal_set, const size_t z, const unsigned char *const mask, const size_t row_stride)
+{
+	// Convert to bools, walking the slab in the grid's storage order.
+	voxel_slab_iterator slab(0, res);
+	size_t x, y;
+
+	while(slab.next(x, y))
+	{
+		// The border is never in the set.
+		if( x == 0 || x == res - 1 ||
+			y == 0 || y == res - 1 ||
+			z == 0 || z == res - 1 )
+		{
+			fractal_set.set(x, y, z, false);
+		}
+		else
+		{
+			fractal_set.set(x, y, z, 0 != mask[x*row_stride + y]);
+		}
+	}
+
+	fractal_set.advise_sweep_position(z);
+}
+
+void quaternion_julia_set::store_atlas_masks(voxel_grid &fractal_set, const size_t first_z, const size_t slab_count, const size_t tile_columns, const unsigned char *const atlas)
+{
+	const size_t atlas_width = tile_columns*res;
+
+	for(size_t i = 0; i < slab_count; i++)
+	{
+		const size_t tile_row = i / tile_columns;
+		const size_t tile_column = i % tile_columns;
+
+		store_slab_mask(fractal_set, first_z + i, atlas + tile_row*res*atlas_width + tile_column*res, atlas_width);
+	}
+}
+
+void quaternion_julia_set::store_atlas_masks_from_pixel_buffer(voxel_grid &fractal_set, const size_t first_z, const size_t slab_count, const size_t tile_columns, const GLuint pbo_handle)
+{
+	// Mapping waits for this buffer's readback to finish, but not for any later one.
+	glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo_handle);
+
+	const unsigned char *const atlas = static_cast<const unsigned char *>(glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY));
+
+	if(0 != atlas)
+	{
+		store_atlas_masks(fractal_set, first_z, slab_count, tile_columns, atlas);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+	}
+}
+
+bool quaternion_julia_set::generate_fractal_set_progressively(voxel_grid &fractal_set, const char *const file_name)
+{
+	const std::chrono::steady_clock::time_point pass_start_time = std::chrono::steady_clock::now();
+
+	// Which voxels have a known value so far.
+	voxel_grid known;
+
+	if(false == allocate_grid(known, file_name))
+		return false;
+
+	// Start from a lattice stride of up to 8, keeping at least a couple of cells per axis.
+	size_t stride = 8;
+
+	while(1 < stride && (res - 1) / stride < 2)
+		stride /= 2;
+
+	const size_t initial_stride = stride;
+
+	size_t level_count = 1;
+
+	for(size_t i = initial_stride; i > 1; i /= 2)
+		level_count++;
+
+	bool completed = true;
+
+	GLint shader_handle = 0;
+	GLuint fbo_handle = 0;
+	GLuint tex_fbo_handle = 0;
+	GLuint tex_in_handle = 0;
+	GLint max_tex_size = 0;
+
+	if(true == opengl_init_ok)
+	{
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_tex_size);
+
+		// Load and compile shader.
+		if(false == initialize_fragment_shader(eqparser.emit_point_list_fragment_shader_code(), shader_handle))
+			return false;
+
+		glGenTextures(1, &tex_in_handle);
+		glBindTexture(GL_TEXTURE_2D, tex_in_handle);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenFramebuffersEXT(1, &fbo_handle);
+		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_handle);
+		glGenTextures(1, &tex_fbo_handle);
+		glBindTexture(GL_TEXTURE_2D, tex_fbo_handle);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glUseProgram(shader_handle);
+		glUniform1i(glGetUniformLocation(shader_handle, "z_xyz"), 0); // Use texture 0.
+		glUniform1f(glGetUniformLocation(shader_handle, "z_w"), z_w);
+		glUniform4f(glGetUniformLocation(shader_handle, "c"), C.x, C.y, C.z, C.w);
+		glUniform1i(glGetUniformLocation(shader_handle, "max_iterations"), max_iterations);
+		glUniform1f(glGetUniformLocation(shader_handle, "threshold"), threshold);
+		glUniform1f(glGetUniformLocation(shader_handle, "periodicity_epsilon"), eqparser.get_periodicity_epsilon());
+	}
+
+	vector<float> input;
+	vector<float> output;
+	vector<size_t> pending_x, pending_y;
+
+	for(size_t level = 1; ; level++, stride /= 2)
 	{
-		for(size_t y = 0; y < res; y++)
+		log_output << "Progressive level " << level << ": every " << stride << " grid point(s)" << endl;
+
+		const std::chrono::steady_clock::time_point level_start_time = std::chrono::steady_clock::now();
+		const size_t coarse_stride = 2*stride;
+		size_t evaluated_count = 0, inferred_count = 0;
+
+		// A coarse cell's points can be inferred only if the whole neighbourhood of coarse cells around it agrees.
+		// Checking the cell's own eight corners is not enough: a feature poking in through a face would be lost.
+		voxel_grid inferable;
+		const size_t cell_count = (res - 1) / coarse_stride;
+
+		if(stride < initial_stride)
 		{
-			for(size_t z = 0; z < res; z++)
+			if(false == allocate_grid(inferable, file_name, cell_count))
 			{
-				size_t set_index = x*res*res + y*res + z;
+				completed = false;
+				break;
+			}
 
-				if( x == 0 || x == res - 1 || 
-					y == 0 || y == res - 1 ||
-					z == 0 || z == res - 1 )
+			find_inferable_cells(fractal_set, coarse_stride, cell_count, inferable);
+		}
+
+		for(size_t z = 0; z < res; z += stride)
+		{
+			input.clear();
+			pending_x.clear();
+			pending_y.clear();
+
+			for(size_t y = 0; y < res; y += stride)
+			{
+				for(size_t x = 0; x < res; x += stride)
 				{
-					fractal_set[set_index] = false;
+					// Already known from a coarser level.
+					if(true == known.get(x, y, z))
+						continue;
+
+					known.set(x, y, z, true);
+
+					// The border is never in the set.
+					if( x == 0 || x == res - 1 ||
+						y == 0 || y == res - 1 ||
+						z == 0 || z == res - 1 )
+					{
+						fractal_set.set(x, y, z, false);
+						continue;
+					}
+
+					// If the coarse cells around this point all agree, assume the point agrees too, rather than evaluating it.
+					if(stride < initial_stride)
+					{
+						const size_t cell_x = x / coarse_stride, cell_y = y / coarse_stride, cell_z = z / coarse_stride;
+
+						if( cell_x < cell_count && cell_y < cell_count && cell_z < cell_count &&
+							true == inferable.get(cell_x, cell_y, cell_z) )
+						{
+							fractal_set.set(x, y, z, fractal_set.get(cell_x*coarse_stride, cell_y*coarse_stride, cell_z*coarse_stride));
+							inferred_count++;
+							continue;
+						}
+					}
+
+					pending_x.push_back(x);
+					pending_y.push_back(y);
+					input.push_back(grid_min + x*step_size);
+					input.push_back(grid_min + y*step_size);
+					input.push_back(grid_min + z*step_size);
 				}
 			}
+
+			const size_t num_points = pending_x.size();
+
+			if(0 == num_points)
+				continue;
+
+			evaluated_count += num_points;
+			output.resize(num_points*3);
+
+			if(true == opengl_init_ok)
+			{
+				// Lay the points out row by row in a texture no wider than the GPU allows.
+				const size_t tex_size_x = (num_points < static_cast<size_t>(max_tex_size)) ? num_points : max_tex_size;
+				const size_t tex_size_y = (num_points + tex_size_x - 1) / tex_size_x;
+
+				input.resize(tex_size_x*tex_size_y*3, 0);
+				output.resize(tex_size_x*tex_size_y*3, 0);
+
+				// Writing a preview tesselates with its own program and framebuffer, so bind ours again.
+				glUseProgram(shader_handle);
+				glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_handle);
+
+				glBindTexture(GL_TEXTURE_2D, tex_fbo_handle);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F_ARB, tex_size_x, tex_size_y, 0, GL_RGB, GL_FLOAT, 0);
+				glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, tex_fbo_handle, 0);
+
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_2D, tex_in_handle);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F_ARB, tex_size_x, tex_size_y, 0, GL_RGB, GL_FLOAT, &input[0]);
+
+				glMatrixMode(GL_PROJECTION);
+				glLoadIdentity();
+				glOrtho(0, 1, 0, 1, 0, 1);
+				glMatrixMode(GL_MODELVIEW);
+				glLoadIdentity();
+				glViewport(0, 0, tex_size_x, tex_size_y);
+
+				glBegin(GL_QUADS);
+					glTexCoord2f(0, 1);	glVertex2f(0, 1);
+					glTexCoord2f(0, 0);	glVertex2f(0, 0);
+					glTexCoord2f(1, 0);	glVertex2f(1, 0);
+					glTexCoord2f(1, 1);	glVertex2f(1, 1);
+				glEnd();
+
+				glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+				glReadPixels(0, 0, tex_size_x, tex_size_y, GL_RGB, GL_FLOAT, &output[0]);
+			}
+			else
+			{
+				for(size_t i = 0; i < num_points; i++)
+					output[i*3] = eqparser.iterate(quaternion(input[i*3 + 0], input[i*3 + 1], input[i*3 + 2], z_w), max_iterations, threshold);
+			}
+
+			for(size_t i = 0; i < num_points; i++)
+				fractal_set.set(pending_x[i], pending_y[i], z, threshold > output[i*3]);
+
+			if(false == report_progress("generate set", (level - 1 + static_cast<float>(z + 1) / res) / level_count))
+			{
+				completed = false;
+				break;
+			}
+		}
+
+		if(false == completed)
+			break;
+
+		log_output << evaluated_count << " points evaluated, " << inferred_count << " inferred from the previous level" << endl;
+
+		if(1 == stride)
+			break;
+
+		// Check the time budget between levels. The first level also pays for start-up, so go by the levels after it.
+		if(0 < time_budget_seconds && 1 < level && 0 < evaluated_count && 16 < res)
+		{
+			const double level_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - level_start_time).count();
+			const double seconds_per_point = level_seconds / evaluated_count;
+
+			// Each finer level adds the points of its lattice that are not on the coarser one.
+			// About as large a share of them will need evaluating as at this level; fewer, in practice,
+			// since the surface takes up a smaller share of each finer level.
+			const double evaluated_share = static_cast<double>(evaluated_count) / (evaluated_count + inferred_count);
+			double remaining_points = 0;
+
+			for(size_t s = stride / 2; s >= 1; s /= 2)
+			{
+				const double fine_points = pow(static_cast<double>((res - 1) / s + 1), 3.0);
+				const double coarse_points = pow(static_cast<double>((res - 1) / (2*s) + 1), 3.0);
+				remaining_points += fine_points - coarse_points;
+			}
+
+			const double pass_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start_time).count();
+
+			if(false == check_projected_set_generation_time(pass_seconds, pass_seconds + remaining_points*evaluated_share*seconds_per_point))
+			{
+				completed = false;
+				break;
+			}
+		}
+
+		// Runs that produce the mesh in memory have nowhere to put previews.
+		if(0 == file_name || '\0' == file_name[0])
+			continue;
+
+		// Write a preview of this level, so that the user can abort early if it looks wrong.
+		ostringstream oss;
+		oss << file_name << ".preview" << level << ".stl";
+
+		if(false == write_progressive_preview(fractal_set, stride, oss.str()))
+		{
+			log_output << "Could not write preview " << oss.str() << endl;
+		}
+		else
+		{
+			log_output << "Wrote preview " << oss.str() << endl;
 		}
 	}
 
@@ -785,100 +1880,174 @@ bool quaternion_julia_set::generate_fractal_set(vector<bool> &fractal_set)
 	{
 		// Cleanup OpenGL objects.
 		glDeleteTextures(1, &tex_in_handle);
-		glDeleteTextures(1, &tex_out_handle);
 		glDeleteTextures(1, &tex_fbo_handle);
 		glDeleteFramebuffersEXT(1, &fbo_handle);
 		glUseProgram(0);
 		glDeleteProgram(shader_handle);
 	}
 
-	return true;
+	return completed;
+}
+
+void quaternion_julia_set::find_inferable_cells(const voxel_grid &fractal_set, const size_t coarse_stride, const size_t cell_count, voxel_grid &inferable)
+{
+	const long long num_cells = static_cast<long long>(cell_count);
+
+	// Each thread writes whole z-layers of cells, so no two threads share a word of the grid.
+	#pragma omp parallel for schedule(dynamic, 1)
+	for(long long cell_z = 0; cell_z < num_cells; cell_z++)
+	{
+		// The coarse lattice points of a cell and its 26 neighbours run from one before the cell to two after it,
+		// clamped to the lattice. Lattice point i lies at i*coarse_stride, and there are cell_count + 1 of them per axis.
+		const size_t z_begin = (0 < cell_z) ? cell_z - 1 : 0, z_end = std::min<size_t>(cell_z + 2, cell_count);
+
+		for(size_t cell_y = 0; cell_y < cell_count; cell_y++)
+		{
+			const size_t y_begin = (0 < cell_y) ? cell_y - 1 : 0, y_end = std::min(cell_y + 2, cell_count);
+
+			for(size_t cell_x = 0; cell_x < cell_count; cell_x++)
+			{
+				const size_t x_begin = (0 < cell_x) ? cell_x - 1 : 0, x_end = std::min(cell_x + 2, cell_count);
+				const bool value = fractal_set.get(cell_x*coarse_stride, cell_y*coarse_stride, cell_z*coarse_stride);
+				bool agree = true;
+
+				for(size_t k = z_begin; k <= z_end && true == agree; k++)
+					for(size_t j = y_begin; j <= y_end && true == agree; j++)
+						for(size_t i = x_begin; i <= x_end && true == agree; i++)
+							if(value != fractal_set.get(i*coarse_stride, j*coarse_stride, k*coarse_stride))
+								agree = false;
+
+				inferable.set(cell_x, cell_y, cell_z, agree);
+			}
+		}
+	}
+}
+
+bool quaternion_julia_set::write_progressive_preview(const voxel_grid &fractal_set, const size_t stride, const string &preview_file_name)
+{
+	// Pick out the points of this level's lattice into a coarse grid.
+	const size_t preview_res = (res - 1) / stride + 1;
+	voxel_grid preview;
+
+	if(false == preview.allocate(preview_res))
+		return false;
+
+	for(size_t z = 1; z < preview_res - 1; z++)
+		for(size_t y = 1; y < preview_res - 1; y++)
+			for(size_t x = 1; x < preview_res - 1; x++)
+				preview.set(x, y, z, fractal_set.get(x*stride, y*stride, z*stride));
+
+	// Tesselate at the coarse resolution, streaming straight to disk.
+	// Shells and add / subtract blocks are left out of previews.
+	const size_t full_res = res;
+	const float full_step_size = step_size;
+	const size_t full_vertex_refinement_steps = vertex_refinement_steps;
+
+	res = preview_res;
+	step_size = full_step_size*stride;
+	vertex_refinement_steps = 0;
+
+	stereo_lithography_stream sls(preview_file_name.c_str());
+	bool tesselated = tesselate_set(preview, sls, "preview");
+
+	res = full_res;
+	step_size = full_step_size;
+	vertex_refinement_steps = full_vertex_refinement_steps;
+
+	return tesselated && sls.is_ok();
 }
 
-void quaternion_julia_set::get_surface_set(const vector<bool> &fractal_set, vector<bool> &surface)
+void quaternion_julia_set::get_surface_set(const voxel_grid &fractal_set, voxel_grid &surface)
 {
-	if(0 == fractal_set.size())
+	if(0 == fractal_set.get_res())
 		return;
 
-	surface.resize(fractal_set.size(), false);
-
 	// Skip the first and last of each dimension, since we know those are not in the set by default
 	// (they make up the border).
-	for(size_t x = 1; x < res - 1; x++)
+	for(size_t z = 1; z < res - 1; z++)
 	{
-		for(size_t y = 1; y < res - 1; y++)
-		{
-			for(size_t z = 1; z < res - 1; z++)
-			{
-				size_t set_index = x*res*res + y*res + z;
+		voxel_slab_iterator slab(1, res - 1);
+		size_t x, y;
 
-				// If not in set, it definitely won't be part of the surface set.
-				if(false == fractal_set[set_index])
-					continue;
+		while(slab.next(x, y))
+		{
+			// If not in set, it definitely won't be part of the surface set.
+			if(false == fractal_set.get(x, y, z))
+				continue;
 
-				// Search for any neighbours not in set -- if one is found, then this is part of the surface set.
-				for(signed char i = -1; i <= 1; i++)
+			// Search for any neighbours not in set -- if one is found, then this is part of the surface set.
+			for(signed char k = -1; k <= 1; k++)
+			{
+				for(signed char j = -1; j <= 1; j++)
 				{
-					for(signed char j = -1; j <= 1; j++)
+					for(signed char i = -1; i <= 1; i++)
 					{
-						for(signed char k = -1; k <= 1; k++)
+						if(false == fractal_set.get(x + i, y + j, z + k))
 						{
-							size_t neighbour_index = (x + i)*res*res + (y + j)*res + (z + k);
-
-							if(false == fractal_set[neighbour_index])
-							{
-								surface[set_index] = true;
-								i = j = k = 2; // No need to look at any remaining neighbours.
-							}
+							surface.set(x, y, z, true);
+							i = j = k = 2; // No need to look at any remaining neighbours.
 						}
 					}
-				} // End: for(signed char i = -1; ...
-			}
+				}
+			} // End: for(signed char k = -1; ...
 		}
-	} // End: for(size_t x = 1; ...
+
+		fractal_set.advise_sweep_position(z);
+		surface.advise_sweep_position(z);
+	} // End: for(size_t z = 1; ...
 }
 
-void quaternion_julia_set::thicken_shell(const vector<bool> &fractal_set, vector<bool> &shell)
+bool quaternion_julia_set::thicken_shell(const voxel_grid &fractal_set, voxel_grid &shell, const char *const file_name, const size_t pass, const size_t pass_count)
 {
-	vector<bool> initial_shell = shell;
+	voxel_grid initial_shell;
+
+	if(false == allocate_grid(initial_shell, file_name))
+		return false;
+
+	initial_shell.copy_from(shell);
 
 	// Skip the first and last of each dimension, since we know those are not in the set by default
 	// (they make up the border).
-	for(size_t x = 1; x < res - 1; x++)
+	for(size_t z = 1; z < res - 1; z++)
 	{
-		for(size_t y = 1; y < res - 1; y++)
-		{
-			for(size_t z = 1; z < res - 1; z++)
-			{
-				size_t set_index = x*res*res + y*res + z;
+		voxel_slab_iterator slab(1, res - 1);
+		size_t x, y;
 
-				// If already in shell or not in the set, skip it.
-				if(true == initial_shell[set_index] || false == fractal_set[set_index])
-					continue;
+		while(slab.next(x, y))
+		{
+			// If already in shell or not in the set, skip it.
+			if(true == initial_shell.get(x, y, z) || false == fractal_set.get(x, y, z))
+				continue;
 
-				// Search for any neighbours in shell -- if one is found, then this is part of the shell.
-				for(signed char i = -1; i <= 1; i++)
+			// Search for any neighbours in shell -- if one is found, then this is part of the shell.
+			for(signed char k = -1; k <= 1; k++)
+			{
+				for(signed char j = -1; j <= 1; j++)
 				{
-					for(signed char j = -1; j <= 1; j++)
+					for(signed char i = -1; i <= 1; i++)
 					{
-						for(signed char k = -1; k <= 1; k++)
+						if(true == initial_shell.get(x + i, y + j, z + k))
 						{
-							size_t neighbour_index = (x + i)*res*res + (y + j)*res + (z + k);
-
-							if(true == initial_shell[neighbour_index])
-							{
-								shell[set_index] = true;
-								i = j = k = 2; // No need to look at any remaining neighbours.
-							}
+							shell.set(x, y, z, true);
+							i = j = k = 2; // No need to look at any remaining neighbours.
 						}
 					}
-				} // End: for(signed char i = -1; ...
-			}
+				}
+			} // End: for(signed char k = -1; ...
 		}
+
+		fractal_set.advise_sweep_position(z);
+		initial_shell.advise_sweep_position(z);
+		shell.advise_sweep_position(z);
+
+		if(false == report_progress("shell", (pass + static_cast<float>(z) / (res - 2)) / pass_count))
+			return false;
 	}
+
+	return true;
 }
 
-void quaternion_julia_set::add_to_set(vector<bool> &fractal_set, const addsub_block &b)
+void quaternion_julia_set::add_to_set(voxel_grid &fractal_set, const addsub_block &b)
 {
 	size_t x0 = static_cast<size_t>(floorf(0.5f + static_cast<float>(res - 1) * b.start_x));
 	size_t x1 = static_cast<size_t>(floorf(0.5f + static_cast<float>(res - 1) * b.end_x));
@@ -902,14 +2071,13 @@ void quaternion_julia_set::add_to_set(vector<bool> &fractal_set, const addsub_bl
 					y == 0 || z == res - 1 )
 					continue;
 
-				size_t set_index = x*res*res + y*res + z;
-				fractal_set[set_index] = true;
+				fractal_set.set(x, y, z, true);
 			}
 		}
 	}
 }
 
-void quaternion_julia_set::subtract_from_set(vector<bool> &fractal_set, const addsub_block &b)
+void quaternion_julia_set::subtract_from_set(voxel_grid &fractal_set, const addsub_block &b)
 {
 	size_t x0 = static_cast<size_t>(floorf(0.5f + static_cast<float>(res - 1) * b.start_x));
 	size_t x1 = static_cast<size_t>(floorf(0.5f + static_cast<float>(res - 1) * b.end_x));
@@ -924,685 +2092,656 @@ void quaternion_julia_set::subtract_from_set(vector<bool> &fractal_set, const ad
 		{
 			for(size_t z = z0; z <= z1; z++)
 			{
-				size_t set_index = x*res*res + y*res + z;
-				fractal_set[set_index] = false;
+				fractal_set.set(x, y, z, false);
 			}
 		}
 	}
 }
 
-void quaternion_julia_set::init_grid_cube(mc_grid_cube &cube, const size_t cube_x, const size_t cube_y, const size_t cube_z, const vector<bool> &fractal_set)
-{
-	// Note: default notation for MC -- small values (ie. false) are inside of the surface, large values (ie. true) are outside of the surface.
-	// This is why we must negate before assigning to cube.value[...].
-
-	size_t x_offset = 0;
-	size_t y_offset = 0;
-	size_t z_offset = 0;
-
-	// Setup vertex 0
-	x_offset = 0;
-	y_offset = 0;
-	z_offset = 0;
-	cube.vertex[0].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[0].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[0].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[0] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-
-	// Setup vertex 1
-	x_offset = 1;
-	y_offset = 0;
-	z_offset = 0;
-	cube.vertex[1].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[1].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[1].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[1] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-
-	// Setup vertex 2
-	x_offset = 1;
-	y_offset = 0;
-	z_offset = 1;
-	cube.vertex[2].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[2].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[2].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[2] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-
-	// Setup vertex 3
-	x_offset = 0; 
-	y_offset = 0;
-	z_offset = 1;
-	cube.vertex[3].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[3].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[3].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[3] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-
-	// Setup vertex 4
-	x_offset = 0;
-	y_offset = 1;
-	z_offset = 0;
-	cube.vertex[4].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[4].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[4].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[4] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-
-	// Setup vertex 5
-	x_offset = 1;
-	y_offset = 1;
-	z_offset = 0;
-	cube.vertex[5].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[5].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[5].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[5] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-
-	// Setup vertex 6
-	x_offset = 1;
-	y_offset = 1;
-	z_offset = 1;
-	cube.vertex[6].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[6].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[6].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[6] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-
-	// Setup vertex 7
-	x_offset = 0;
-	y_offset = 1;
-	z_offset = 1;
-	cube.vertex[7].x = grid_min + ((cube_x + x_offset) * step_size);
-	cube.vertex[7].y = grid_min + ((cube_y + y_offset) * step_size);
-	cube.vertex[7].z = grid_min + ((cube_z + z_offset) * step_size);
-	cube.value[7] = !fractal_set[(cube_x + x_offset)*res*res + (cube_y + y_offset)*res + (cube_z + z_offset)];
-}
-
-bool quaternion_julia_set::tesselate_set(const vector<bool> &fractal_set, indexed_mesh &m)
+bool quaternion_julia_set::tesselate_set(const voxel_grid &fractal_set, triangle_sink &sink, const char *const stage_name)
 {
+	GLint case_shader_handle = 0;
+	GLint reduction_shader_handle = 0;
 	GLint shader_handle = 0;
 	GLuint fbo_handle = 0;
-	GLuint tex_fbo_handle = 0;
-	GLuint tex_in0_handle = 0;
-	GLuint tex_in1_handle = 0;
+	GLuint tex_scratch_handle = 0;
+	GLuint tex_pyramid_handle = 0;
 	GLuint tex_out_handle = 0;
-	const GLint tex_in_internal_format = GL_RGBA32F_ARB;
-	const GLint tex_in_format = GL_RGBA;
-	const GLint tex_out_internal_format = GL_RGBA32F_ARB; // Note: We only need three channels, but using RGB on AMD 6310 causes some small errors related to bit corruption ...
-	const GLint tex_out_format = GL_RGBA;
+	GLuint tex_tables_handle = 0;
+	GLuint tex_slabs_handle = 0;
+	const GLint tex_internal_format = GL_RGBA32F_ARB; // Note: We only need three channels, but using RGB on AMD 6310 causes some small errors related to bit corruption ...
+	const GLint tex_format = GL_RGBA;
 	const GLint var_type = GL_FLOAT;
 
+	// On the GPU, the edge counts of a layer of cubes are summed 2 x 2 at a time into a pyramid of
+	// levels that halve in size down to one texel (a histogram pyramid). The vertex interpolation shader
+	// finds the cube and edge for each entry of the compacted edge list by walking down the pyramid,
+	// so only the final vertices are read back. The levels sit side by side in one atlas.
+	// Only the part of each level that covers the grid is ever drawn; the rest stays zero.
+	size_t pyramid_base_size = 1;
+	size_t pyramid_levels = 0;
+
+	while(pyramid_base_size < res - 1)
+	{
+		pyramid_base_size *= 2;
+		pyramid_levels++;
+	}
+
+	GLint max_tex_size = 0;
+	size_t out_tex_size_x = 0;
+	size_t out_tex_size_y = 0;
+	mc_layer_workspace workspace;
+	workspace.reserve(res, 0);
+
 	if(true == opengl_init_ok)
 	{
-		ofstream of("vertex_interp_shader.txt");
-		of << eqparser.emit_vertex_interp_fragment_shader_code() << "\n// Equation text: " << equation_text << endl;
-		of.close();
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_tex_size);
 
-		// Load and compile shader.
-		if(false == initialize_fragment_shader(eqparser.emit_vertex_interp_fragment_shader_code(), shader_handle))
+		if(static_cast<size_t>(max_tex_size) < 2*pyramid_base_size)
+		{
+			ostringstream oss;
+			oss << "GPU max texture size (" << max_tex_size << ") is not large enough.";
+			status_string = oss.str();
+
+			return false;
+		}
+
+		if(true == write_shader_files)
+		{
+			ofstream of("vertex_interp_shader.txt");
+			of << eqparser.emit_vertex_interp_fragment_shader_code() << "\n// Equation text: " << equation_text << endl;
+			of.close();
+		}
+
+		// Load and compile shaders.
+		if( false == initialize_fragment_shader(eqparser.emit_cube_case_fragment_shader_code(), case_shader_handle) ||
+			false == initialize_fragment_shader(eqparser.emit_count_reduction_fragment_shader_code(), reduction_shader_handle) ||
+			false == initialize_fragment_shader(eqparser.emit_vertex_interp_fragment_shader_code(), shader_handle) )
+		{
+			glDeleteProgram(case_shader_handle);
+			glDeleteProgram(reduction_shader_handle);
+			glDeleteProgram(shader_handle);
 			return false;
+		}
 
 		// Allocate OpenGL objects.
-		glGenTextures(1, &tex_in0_handle);
-		glBindTexture(GL_TEXTURE_1D, tex_in0_handle);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-
-		glGenTextures(1, &tex_in1_handle);
-		glBindTexture(GL_TEXTURE_1D, tex_in1_handle);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		GLuint *const tex_handles[] = { &tex_scratch_handle, &tex_pyramid_handle, &tex_out_handle, &tex_tables_handle, &tex_slabs_handle };
 
-		glGenTextures(1, &tex_out_handle);
-		glBindTexture(GL_TEXTURE_1D, tex_out_handle);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		for(size_t i = 0; i < sizeof(tex_handles)/sizeof(tex_handles[0]); i++)
+		{
+			glGenTextures(1, tex_handles[i]);
+			glBindTexture(GL_TEXTURE_2D, *tex_handles[i]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
 
-		// Initialize FBO and FBO output texture.
-		// These are used to "draw" to a texture instead of to the screen (render-to-texture).
+		// Each level is drawn into the scratch texture, then copied into its place in the pyramid atlas.
+		glBindTexture(GL_TEXTURE_2D, tex_scratch_handle);
+		glTexImage2D(GL_TEXTURE_2D, 0, tex_internal_format, pyramid_base_size, pyramid_base_size, 0, tex_format, var_type, 0);
+
+		glBindTexture(GL_TEXTURE_2D, tex_pyramid_handle);
+		glTexImage2D(GL_TEXTURE_2D, 0, tex_internal_format, 2*pyramid_base_size, pyramid_base_size, 0, tex_format, var_type, 0);
+
+		// Row 0 holds each case's edge count. Row 1 + k holds the k-th edge of the case with a vertex on it,
+		// counting in edge order, as the offset of the edge's low end (rgb) and its direction (a).
+		const mc_case *const cases = get_case_table();
+		const size_t table_rows = 1 + max_edges_per_mt_cell;
+		vector<float> tables(256*table_rows*4, 0);
+
+		for(size_t i = 0; i < 256; i++)
+		{
+			for(size_t k = 0; k < cases[i].edge_count; k++)
+			{
+				const size_t index = ((1 + k)*256 + i)*4;
+				const size_t edge = cases[i].edges[k];
+
+				tables[index + 0] = mc_cube_edge_ids[edge][0];
+				tables[index + 1] = mc_cube_edge_ids[edge][1];
+				tables[index + 2] = mc_cube_edge_ids[edge][2];
+				tables[index + 3] = mc_cube_edge_ids[edge][3];
+			}
+
+			tables[i*4 + 0] = static_cast<float>(cases[i].edge_count);
+		}
+
+		glBindTexture(GL_TEXTURE_2D, tex_tables_handle);
+		glTexImage2D(GL_TEXTURE_2D, 0, tex_internal_format, 256, table_rows, 0, tex_format, var_type, &tables[0]);
+
+		// The bit grid goes up one layer at a time, as a byte for the slab below (luminance)
+		// and a byte for the slab above (alpha) per grid point.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		glBindTexture(GL_TEXTURE_2D, tex_slabs_handle);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8_ALPHA8, res, res, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, 0);
+
+		// Initialize FBO.
+		// This is used to "draw" to a texture instead of to the screen (render-to-texture).
 		glGenFramebuffersEXT(1, &fbo_handle);
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo_handle);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
 
-		glGenTextures(1, &tex_fbo_handle);
-		glBindTexture(GL_TEXTURE_1D, tex_fbo_handle);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, tex_pyramid_handle, 0);
+		glClearColor(0, 0, 0, 0);
+		glClear(GL_COLOR_BUFFER_BIT);
 
 		// Initial setup for "drawing".
+		// Texture unit 0 holds the pyramid atlas, 1 the slabs below and above the cubes, 2 the tables.
+		glUseProgram(case_shader_handle);
+		glUniform1i(glGetUniformLocation(case_shader_handle, "slabs"), 1);
+		glUniform1i(glGetUniformLocation(case_shader_handle, "mc_tables"), 2);
+		glUniform1f(glGetUniformLocation(case_shader_handle, "grid_res"), static_cast<float>(res));
+		glUniform1f(glGetUniformLocation(case_shader_handle, "table_rows"), static_cast<float>(1 + max_edges_per_mt_cell));
+
+		glUseProgram(reduction_shader_handle);
+		glUniform1i(glGetUniformLocation(reduction_shader_handle, "pyramid"), 0);
+		glUniform2f(glGetUniformLocation(reduction_shader_handle, "pyramid_atlas_size"), static_cast<float>(2*pyramid_base_size), static_cast<float>(pyramid_base_size));
+
 		glUseProgram(shader_handle);
-		glUniform1i(glGetUniformLocation(shader_handle, "input0"), 0); // Use texture 0.
-		glUniform1i(glGetUniformLocation(shader_handle, "input1"), 1); // Use texture 1.
+		glUniform1i(glGetUniformLocation(shader_handle, "pyramid"), 0);
+		glUniform2f(glGetUniformLocation(shader_handle, "pyramid_atlas_size"), static_cast<float>(2*pyramid_base_size), static_cast<float>(pyramid_base_size));
+		glUniform1f(glGetUniformLocation(shader_handle, "pyramid_base_size"), static_cast<float>(pyramid_base_size));
+		glUniform1i(glGetUniformLocation(shader_handle, "pyramid_levels"), static_cast<GLint>(pyramid_levels));
+		glUniform1i(glGetUniformLocation(shader_handle, "slabs"), 1);
+		glUniform1i(glGetUniformLocation(shader_handle, "mc_tables"), 2);
+		glUniform1f(glGetUniformLocation(shader_handle, "table_rows"), static_cast<float>(1 + max_edges_per_mt_cell));
+		glUniform1f(glGetUniformLocation(shader_handle, "grid_res"), static_cast<float>(res));
+		glUniform1f(glGetUniformLocation(shader_handle, "grid_min"), grid_min);
+		glUniform1f(glGetUniformLocation(shader_handle, "step_size"), step_size);
 		glUniform1f(glGetUniformLocation(shader_handle, "z_w"), z_w);
 		glUniform4f(glGetUniformLocation(shader_handle, "c"), C.x, C.y, C.z, C.w);
 		glUniform1i(glGetUniformLocation(shader_handle, "max_iterations"), max_iterations);
 		glUniform1f(glGetUniformLocation(shader_handle, "threshold"), threshold);
+		glUniform1f(glGetUniformLocation(shader_handle, "periodicity_epsilon"), eqparser.get_periodicity_epsilon());
 		glUniform1i(glGetUniformLocation(shader_handle, "vertex_refinement_steps"), vertex_refinement_steps);
+
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, tex_slabs_handle);
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, tex_tables_handle);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, tex_pyramid_handle);
+
+		glMatrixMode(GL_PROJECTION);
+		glLoadIdentity();
+		glOrtho(0, 1, 0, 1, 0, 1);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
 	}
 
-	m.init_triangle_insertion();
+	const GLint level_below_offset_location = (true == opengl_init_ok) ? glGetUniformLocation(reduction_shader_handle, "level_below_offset") : -1;
+	const GLint cube_z_location = (true == opengl_init_ok) ? glGetUniformLocation(shader_handle, "cube_z") : -1;
+	const GLint output_width_location = (true == opengl_init_ok) ? glGetUniformLocation(shader_handle, "output_width") : -1;
 
-	for(size_t cube_z = 0; cube_z < res - 1; cube_z++)
-	{
-		cout << "Tesselating grid cube array " << cube_z + 1 << " of " << res - 1 << endl;
+	// With pixel buffer objects, the vertices of one layer of cubes are read back while the CPU
+	// makes the triangles of the layer before.
+	const bool use_pixel_buffers = (true == opengl_init_ok && GLEW_ARB_pixel_buffer_object);
+	GLuint pbo_handles[2] = { 0, 0 };
+	size_t pbo_sizes[2] = { 0, 0 };
+	bool layer_pending = false;
+	size_t pending_cube_z = 0;
 
-		// Get input for shader.
-		// Contains four floats per vertex interpolation (3 for vertex position, 1 for value).
-		// input0 contains the first vertex in each pair, input1 contains the second vertex in each pair.
-		vector<float> input0, input1;
+	if(true == use_pixel_buffers)
+		glGenBuffers(2, pbo_handles);
 
-		for(size_t cube_x = 0; cube_x < res - 1; cube_x++)
-		{
-			for(size_t cube_y = 0; cube_y < res - 1; cube_y++)
-			{
-				mc_grid_cube cube;
+	sink.init_triangle_insertion();
 
-				init_grid_cube(cube, cube_x, cube_y, cube_z, fractal_set);
-				get_vertex_interp_input_from_grid_cube(cube, input0, input1);
-			}
-		}
+	bool completed = true;
 
-		// If there were absolutely no vertex interps generated, then there will be absolutely no
-		// triangles in this grid cube array, so just continue to the next grid cube array.
-		if(0 == input0.size())
-			continue;
+	for(size_t cube_z = 0; cube_z < res - 1; cube_z++)
+	{
+		log_output << "Tesselating grid cube array " << cube_z + 1 << " of " << res - 1 << endl;
 
+		if(false == report_progress(stage_name, static_cast<float>(cube_z) / (res - 1)))
+		{
+			completed = false;
+			break;
+		}
 
-		// Calculate output via shader.
-		const size_t num_vertex_interps = input0.size()/4;
-		
-		// Contains three floats per vertex interpolation (3 for vertex position).
-		vector<float> output(num_vertex_interps*4, 0);
+		fractal_set.advise_sweep_position(cube_z);
 
+		bool gpu_edge_list = false;
+		bool gpu_vertices = false;
 
 		if(true == opengl_init_ok)
 		{
-			size_t num_vertex_interps_remaining = num_vertex_interps;
+			upload_slab_texture(fractal_set, cube_z, tex_slabs_handle, workspace.slab_bytes);
 
-			GLint max_tex_size = 0;
+			// Classify the cubes into the base of the pyramid.
+			size_t level_size = res - 1;
 
-			glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_tex_size);
-			
-			while(0 < num_vertex_interps_remaining)
-			{
-				size_t tex_size_x;
-
-				if(num_vertex_interps_remaining > static_cast<size_t>(max_tex_size))
-					tex_size_x = max_tex_size;
-				else
-					tex_size_x = num_vertex_interps_remaining;
+			glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, tex_scratch_handle, 0);
+			glUseProgram(case_shader_handle);
+			glViewport(0, 0, level_size, level_size);
 
-				const size_t index = num_vertex_interps - num_vertex_interps_remaining;
-				const size_t input_index = index*4;
-				const size_t output_index = index*4;
-
-				// Set the FBO size.
-				glBindTexture(GL_TEXTURE_1D, tex_fbo_handle);
-				glTexImage1D(GL_TEXTURE_1D, 0, tex_out_internal_format, tex_size_x, 0, tex_out_format, var_type, 0);
-				glFramebufferTexture1DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_1D, tex_fbo_handle, 0);
+			glBegin(GL_QUADS);
+				glVertex2f(0, 1);
+				glVertex2f(0, 0);
+				glVertex2f(1, 0);
+				glVertex2f(1, 1);
+			glEnd();
 
-				// Write to GPU memory.
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_1D, tex_in0_handle);
-				glTexImage1D(GL_TEXTURE_1D, 0, tex_in_internal_format, tex_size_x, 0, tex_in_format, var_type, &input0[input_index]);
+			glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, level_size, level_size);
 
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_1D, tex_in1_handle);
-				glTexImage1D(GL_TEXTURE_1D, 0, tex_in_internal_format, tex_size_x, 0, tex_in_format, var_type, &input1[input_index]);
+			// Build the levels above it.
+			glUseProgram(reduction_shader_handle);
 
+			for(size_t full_level_size = pyramid_base_size/2; full_level_size > 0; full_level_size /= 2)
+			{
+				level_size = (level_size + 1)/2;
 
-				// Calculate by "drawing".
-				glMatrixMode(GL_PROJECTION);
-				glLoadIdentity();
-				glOrtho(0, 1, 0, 1, 0, 1);
-				glMatrixMode(GL_MODELVIEW);
-				glLoadIdentity();
-				glViewport(0, 0, tex_size_x, 1);
+				glUniform1f(level_below_offset_location, static_cast<float>(2*(pyramid_base_size - 2*full_level_size)));
+				glViewport(0, 0, level_size, level_size);
 
 				glBegin(GL_QUADS);
-					glTexCoord2f(0, 1);	glVertex2f(0, 1);
-					glTexCoord2f(0, 0);	glVertex2f(0, 0);
-					glTexCoord2f(1, 0);	glVertex2f(1, 0);
-					glTexCoord2f(1, 1);	glVertex2f(1, 1);
+					glVertex2f(0, 1);
+					glVertex2f(0, 0);
+					glVertex2f(1, 0);
+					glVertex2f(1, 1);
 				glEnd();
 
-				// Read from GPU memory.
-				glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
-				glReadPixels(0, 0, tex_size_x, 1, tex_out_format, var_type, &output[output_index]);
-
-				num_vertex_interps_remaining -= tex_size_x;
+				glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 2*(pyramid_base_size - full_level_size), 0, 0, 0, level_size, level_size);
 			}
-		}
-		else
-		{
-			for(size_t i = 0; i < num_vertex_interps; i++)
+
+			// While the GPU works on this layer, tesselate the one before it.
+			if(true == layer_pending)
 			{
-				size_t input_index = i*4;
+				tesselate_pixel_buffer_layer(fractal_set, pending_cube_z, pbo_handles[pending_cube_z % 2], workspace, sink);
+				layer_pending = false;
+			}
 
-				vertex_3 in0_vert;
-				in0_vert.x = input0[input_index + 0];
-				in0_vert.y = input0[input_index + 1];
-				in0_vert.z = input0[input_index + 2];
+			// The top of the pyramid is the length of the edge list.
+			GLfloat top[4] = { 0, 0, 0, 0 };
+			glReadPixels(0, 0, 1, 1, GL_RGBA, GL_FLOAT, top);
 
-				vertex_3 in1_vert;
-				in1_vert.x = input1[input_index + 0];
-				in1_vert.y = input1[input_index + 1];
-				in1_vert.z = input1[input_index + 2];
+			// Counts are only exact in single precision up to 2^24; a layer with more edges than that is left to the CPU.
+			if(top[3] < 16777216.0f)
+			{
+				gpu_edge_list = true;
 
-				float in0_val = input0[input_index + 3];
-				float in1_val = input1[input_index + 3];
+				const size_t num_vertex_interps = static_cast<size_t>(top[3]);
 
-				vertex_3 out_vert;
-				out_vert = vertex_interp_float(in0_vert, in1_vert, in0_val, in1_val);
+				// If there were absolutely no vertex interps generated, then there will be absolutely no
+				// triangles in this grid cube array.
+				gpu_vertices = (0 < num_vertex_interps);
 
-				size_t output_index = i*4;
-				output[output_index + 0] = out_vert.x;
-				output[output_index + 1] = out_vert.y;
-				output[output_index + 2] = out_vert.z;
-			}
-		}
+				const size_t tex_size_x = std::max(static_cast<size_t>(1), std::min(num_vertex_interps, static_cast<size_t>(max_tex_size)));
+				const size_t tex_size_y = (num_vertex_interps + tex_size_x - 1) / tex_size_x;
 
+				// Grow the output texture as needed.
+				if(true == gpu_vertices && (tex_size_x > out_tex_size_x || tex_size_y > out_tex_size_y))
+				{
+					out_tex_size_x = std::max(out_tex_size_x, tex_size_x);
+					out_tex_size_y = std::max(out_tex_size_y, tex_size_y);
 
-		// Tesselate output.
-		input0.clear();
-		input1.clear();
+					glBindTexture(GL_TEXTURE_2D, tex_out_handle);
+					glTexImage2D(GL_TEXTURE_2D, 0, tex_internal_format, out_tex_size_x, out_tex_size_y, 0, tex_format, var_type, 0);
+					glBindTexture(GL_TEXTURE_2D, tex_pyramid_handle);
+				}
 
-		size_t current_vertex_index = 0;
+				if(true == gpu_vertices)
+				{
+					// Take the case indices from the base of the pyramid, rather than classifying the cubes again.
+					glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, tex_pyramid_handle, 0);
+					glReadPixels(0, 0, res - 1, res - 1, GL_RED, var_type, &workspace.case_values[0]);
+
+					for(size_t i = 0; i < (res - 1)*(res - 1); i++)
+						workspace.cases[i] = static_cast<unsigned char>(workspace.case_values[i]);
+
+					// Calculate by "drawing".
+					glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_TEXTURE_2D, tex_out_handle, 0);
+					glUseProgram(shader_handle);
+					glUniform1f(cube_z_location, static_cast<float>(cube_z));
+					glUniform1f(output_width_location, static_cast<float>(tex_size_x));
+					glViewport(0, 0, tex_size_x, tex_size_y);
+
+					glBegin(GL_QUADS);
+						glVertex2f(0, 1);
+						glVertex2f(0, 0);
+						glVertex2f(1, 0);
+						glVertex2f(1, 1);
+					glEnd();
+
+					// Read from GPU memory.
+					const size_t output_bytes = tex_size_x*tex_size_y*4*sizeof(float);
+
+					if(true == use_pixel_buffers)
+					{
+						glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo_handles[cube_z % 2]);
 
-		for(size_t cube_x = 0; cube_x < res - 1; cube_x++)
-		{
-			for(size_t cube_y = 0; cube_y < res - 1; cube_y++)
-			{
-				mc_grid_cube cube;
-				triangle temp_triangle_array[max_triangles_per_mc_cell];
+						if(pbo_sizes[cube_z % 2] < output_bytes)
+						{
+							glBufferData(GL_PIXEL_PACK_BUFFER_ARB, output_bytes, 0, GL_STREAM_READ);
+							pbo_sizes[cube_z % 2] = output_bytes;
+						}
 
-				init_grid_cube(cube, cube_x, cube_y, cube_z, fractal_set);
-				short unsigned int number_of_triangles_generated = get_triangles_from_grid_cube(cube, output, current_vertex_index, temp_triangle_array);
+						glReadPixels(0, 0, tex_size_x, tex_size_y, tex_format, var_type, 0);
+						glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+					}
+					else
+					{
+						if(workspace.output.size() < tex_size_x*tex_size_y*4)
+							workspace.output.resize(tex_size_x*tex_size_y*4);
 
-				for(short unsigned int i = 0; i < number_of_triangles_generated; i++)
-					m.insert_triangle(temp_triangle_array[i]);
+						glReadPixels(0, 0, tex_size_x, tex_size_y, tex_format, var_type, &workspace.output[0]);
+					}
+				}
 			}
 		}
-	}
 
-	cout << "Generating mesh adjacency data" << endl;
+		if(true == gpu_vertices && true == use_pixel_buffers)
+		{
+			layer_pending = true;
+			pending_cube_z = cube_z;
+			continue;
+		}
 
-	m.finalize_triangle_insertion();
+		if(true == gpu_edge_list && false == gpu_vertices)
+			continue;
 
-	if(true == opengl_init_ok)
-	{
-		// Cleanup OpenGL objects.
-		glDeleteTextures(1, &tex_in0_handle);
-		glDeleteTextures(1, &tex_in1_handle);
-		glDeleteTextures(1, &tex_out_handle);
-		glDeleteTextures(1, &tex_fbo_handle);
-		glDeleteFramebuffersEXT(1, &fbo_handle);
-		glUseProgram(0);
-		glDeleteProgram(shader_handle);
-	}
+		if(false == gpu_edge_list)
+		{
+			// Classify the cubes, counting up the vertex interps that they need, so that the
+			// workspace can be grown once before the edges are gathered.
+			voxel_morton_iterator case_cubes(res - 1);
+			size_t cube_x, cube_y;
+			size_t num_vertex_interps = 0;
 
-	return true;
-}
+			while(case_cubes.next(cube_x, cube_y))
+			{
+				const unsigned char case_index = get_cube_case_index(fractal_set, cube_x, cube_y, cube_z);
 
-void quaternion_julia_set::get_vertex_interp_input_from_grid_cube(const mc_grid_cube &cube, vector<float> &input0, vector<float> &input1)
-{
-	short unsigned int case_index = 0;
-
-	// Note: default notation for MC -- small values are inside of the surface, large values are outside of the surface.
-	if(false == cube.value[0]) case_index |= 1;
-	if(false == cube.value[1]) case_index |= 2;
-	if(false == cube.value[2]) case_index |= 4;
-	if(false == cube.value[3]) case_index |= 8;
-	if(false == cube.value[4]) case_index |= 16;
-	if(false == cube.value[5]) case_index |= 32;
-	if(false == cube.value[6]) case_index |= 64;
-	if(false == cube.value[7]) case_index |= 128;
-
-	if(0 == mc_edge_table[case_index])
-		return;
+				workspace.cases[cube_y*(res - 1) + cube_x] = case_index;
+				num_vertex_interps += get_case_table()[case_index].edge_count;
+			}
 
-	if(mc_edge_table[case_index] & 1)
-	{
-		input0.push_back(cube.vertex[0].x);
-		input0.push_back(cube.vertex[0].y);
-		input0.push_back(cube.vertex[0].z);
-		input0.push_back(static_cast<float>(cube.value[0]));
+			// If there were absolutely no vertex interps generated, then there will be absolutely no
+			// triangles in this grid cube array, so just continue to the next grid cube array.
+			if(0 == num_vertex_interps)
+				continue;
 
-		input1.push_back(cube.vertex[1].x);
-		input1.push_back(cube.vertex[1].y);
-		input1.push_back(cube.vertex[1].z);
-		input1.push_back(static_cast<float>(cube.value[1]));
-	}
+			workspace.reserve(res, num_vertex_interps);
 
-	if(mc_edge_table[case_index] & 2)
-	{
-		input0.push_back(cube.vertex[1].x);
-		input0.push_back(cube.vertex[1].y);
-		input0.push_back(cube.vertex[1].z);
-		input0.push_back(static_cast<float>(cube.value[1]));
+			// Both passes must visit the cubes in the same order.
+			voxel_morton_iterator input_cubes(res - 1);
+			size_t edge_index = 0;
 
-		input1.push_back(cube.vertex[2].x);
-		input1.push_back(cube.vertex[2].y);
-		input1.push_back(cube.vertex[2].z);
-		input1.push_back(static_cast<float>(cube.value[2]));
-	}
+			while(input_cubes.next(cube_x, cube_y))
+				edge_index += get_edge_ids_from_cube(workspace.cases[cube_y*(res - 1) + cube_x], cube_x, cube_y, cube_z, &workspace.edges[edge_index]);
 
-	if(mc_edge_table[case_index] & 4)
-	{
-		input0.push_back(cube.vertex[2].x);
-		input0.push_back(cube.vertex[2].y);
-		input0.push_back(cube.vertex[2].z);
-		input0.push_back(static_cast<float>(cube.value[2]));
+			// Up to four cubes of the layer share an edge; only find its vertex once.
+			for(size_t i = 0; i < num_vertex_interps; i++)
+			{
+				const mc_edge_id &edge = workspace.edges[i];
+				unsigned int &slot = workspace.edge_slots[(((edge.z - cube_z)*7 + edge.direction - 1)*res + edge.y)*res + edge.x];
 
-		input1.push_back(cube.vertex[3].x);
-		input1.push_back(cube.vertex[3].y);
-		input1.push_back(cube.vertex[3].z);
-		input1.push_back(static_cast<float>(cube.value[3]));
-	}
+				if(false == (slot < i && workspace.edges[slot] == edge))
+					slot = static_cast<unsigned int>(i);
 
-	if(mc_edge_table[case_index] & 8)
-	{
-		input0.push_back(cube.vertex[3].x);
-		input0.push_back(cube.vertex[3].y);
-		input0.push_back(cube.vertex[3].z);
-		input0.push_back(static_cast<float>(cube.value[3]));
+				workspace.first_uses[i] = slot;
+			}
 
-		input1.push_back(cube.vertex[0].x);
-		input1.push_back(cube.vertex[0].y);
-		input1.push_back(cube.vertex[0].z);
-		input1.push_back(static_cast<float>(cube.value[0]));
-	}
+			for(size_t i = 0; i < num_vertex_interps; i++)
+			{
+				if(workspace.first_uses[i] != i)
+					continue;
 
-	if(mc_edge_table[case_index] & 16)
-	{
-		input0.push_back(cube.vertex[4].x);
-		input0.push_back(cube.vertex[4].y);
-		input0.push_back(cube.vertex[4].z);
-		input0.push_back(static_cast<float>(cube.value[4]));
+				const mc_edge_id &edge = workspace.edges[i];
+				const vertex_3 out_vert = vertex_interp(edge, false == fractal_set.get(edge.x, edge.y, edge.z));
 
-		input1.push_back(cube.vertex[5].x);
-		input1.push_back(cube.vertex[5].y);
-		input1.push_back(cube.vertex[5].z);
-		input1.push_back(static_cast<float>(cube.value[5]));
-	}
+				size_t output_index = i*4;
+				workspace.output[output_index + 0] = out_vert.x;
+				workspace.output[output_index + 1] = out_vert.y;
+				workspace.output[output_index + 2] = out_vert.z;
+			}
 
-	if(mc_edge_table[case_index] & 32)
-	{
-		input0.push_back(cube.vertex[5].x);
-		input0.push_back(cube.vertex[5].y);
-		input0.push_back(cube.vertex[5].z);
-		input0.push_back(static_cast<float>(cube.value[5]));
+			for(size_t i = 0; i < num_vertex_interps; i++)
+				if(workspace.first_uses[i] != i)
+					memcpy(&workspace.output[i*4], &workspace.output[workspace.first_uses[i]*4], 3*sizeof(float));
+		}
 
-		input1.push_back(cube.vertex[6].x);
-		input1.push_back(cube.vertex[6].y);
-		input1.push_back(cube.vertex[6].z);
-		input1.push_back(static_cast<float>(cube.value[6]));
+
+		// Tesselate output.
+		tesselate_cube_layer(fractal_set, cube_z, &workspace.output[0], workspace, sink);
 	}
 
-	if(mc_edge_table[case_index] & 64)
+	if(true == use_pixel_buffers)
 	{
-		input0.push_back(cube.vertex[6].x);
-		input0.push_back(cube.vertex[6].y);
-		input0.push_back(cube.vertex[6].z);
-		input0.push_back(static_cast<float>(cube.value[6]));
+		// The last layer is still waiting in its pixel buffer.
+		if(true == completed && true == layer_pending)
+			tesselate_pixel_buffer_layer(fractal_set, pending_cube_z, pbo_handles[pending_cube_z % 2], workspace, sink);
 
-		input1.push_back(cube.vertex[7].x);
-		input1.push_back(cube.vertex[7].y);
-		input1.push_back(cube.vertex[7].z);
-		input1.push_back(static_cast<float>(cube.value[7]));
+		glDeleteBuffers(2, pbo_handles);
 	}
 
-	if(mc_edge_table[case_index] & 128)
-	{
-		input0.push_back(cube.vertex[7].x);
-		input0.push_back(cube.vertex[7].y);
-		input0.push_back(cube.vertex[7].z);
-		input0.push_back(static_cast<float>(cube.value[7]));
+	log_output << "Finalizing triangle output" << endl;
 
-		input1.push_back(cube.vertex[4].x);
-		input1.push_back(cube.vertex[4].y);
-		input1.push_back(cube.vertex[4].z);
-		input1.push_back(static_cast<float>(cube.value[4]));
-	}
+	sink.finalize_triangle_insertion();
 
-	if(mc_edge_table[case_index] & 256)
+	if(true == opengl_init_ok)
 	{
-		input0.push_back(cube.vertex[0].x);
-		input0.push_back(cube.vertex[0].y);
-		input0.push_back(cube.vertex[0].z);
-		input0.push_back(static_cast<float>(cube.value[0]));
-
-		input1.push_back(cube.vertex[4].x);
-		input1.push_back(cube.vertex[4].y);
-		input1.push_back(cube.vertex[4].z);
-		input1.push_back(static_cast<float>(cube.value[4]));
+		// Cleanup OpenGL objects.
+		glDeleteTextures(1, &tex_scratch_handle);
+		glDeleteTextures(1, &tex_pyramid_handle);
+		glDeleteTextures(1, &tex_out_handle);
+		glDeleteTextures(1, &tex_tables_handle);
+		glDeleteTextures(1, &tex_slabs_handle);
+		glDeleteFramebuffersEXT(1, &fbo_handle);
+		glUseProgram(0);
+		glDeleteProgram(case_shader_handle);
+		glDeleteProgram(reduction_shader_handle);
+		glDeleteProgram(shader_handle);
 	}
 
-	if(mc_edge_table[case_index] & 512)
-	{
-		input0.push_back(cube.vertex[1].x);
-		input0.push_back(cube.vertex[1].y);
-		input0.push_back(cube.vertex[1].z);
-		input0.push_back(static_cast<float>(cube.value[1]));
+	return completed;
+}
 
-		input1.push_back(cube.vertex[5].x);
-		input1.push_back(cube.vertex[5].y);
-		input1.push_back(cube.vertex[5].z);
-		input1.push_back(static_cast<float>(cube.value[5]));
+void quaternion_julia_set::tesselate_cube_layer(const voxel_grid &fractal_set, const size_t cube_z, const float *const output, mc_layer_workspace &workspace, triangle_sink &sink)
+{
+	if(SURFACE_NETS == method)
+	{
+		tesselate_surface_net_layer(fractal_set, cube_z, output, workspace, sink);
+		return;
 	}
 
-	if(mc_edge_table[case_index] & 1024)
-	{
-		input0.push_back(cube.vertex[2].x);
-		input0.push_back(cube.vertex[2].y);
-		input0.push_back(cube.vertex[2].z);
-		input0.push_back(static_cast<float>(cube.value[2]));
+	// The cubes are visited in Morton order, which is the order of the GPU's edge list.
+	size_t current_vertex_index = 0;
 
-		input1.push_back(cube.vertex[6].x);
-		input1.push_back(cube.vertex[6].y);
-		input1.push_back(cube.vertex[6].z);
-		input1.push_back(static_cast<float>(cube.value[6]));
-	}
+	voxel_morton_iterator cubes(res - 1);
+	size_t cube_x, cube_y;
 
-	if(mc_edge_table[case_index] & 2048)
+	while(cubes.next(cube_x, cube_y))
 	{
-		input0.push_back(cube.vertex[3].x);
-		input0.push_back(cube.vertex[3].y);
-		input0.push_back(cube.vertex[3].z);
-		input0.push_back(static_cast<float>(cube.value[3]));
+		triangle temp_triangle_array[max_triangles_per_mt_cell];
 
-		input1.push_back(cube.vertex[7].x);
-		input1.push_back(cube.vertex[7].y);
-		input1.push_back(cube.vertex[7].z);
-		input1.push_back(static_cast<float>(cube.value[7]));
+		const unsigned char case_index = workspace.cases[cube_y*(res - 1) + cube_x];
+		short unsigned int number_of_triangles_generated = get_triangles_from_grid_cube(case_index, output, current_vertex_index, temp_triangle_array);
+
+		for(short unsigned int i = 0; i < number_of_triangles_generated; i++)
+			sink.insert_triangle(temp_triangle_array[i]);
 	}
 }
 
-
-short unsigned int quaternion_julia_set::get_triangles_from_grid_cube(const mc_grid_cube &cube, vector<float> &output, size_t &current_vertex_index, triangle *const triangles)
+void quaternion_julia_set::tesselate_pixel_buffer_layer(const voxel_grid &fractal_set, const size_t cube_z, const GLuint pbo_handle, mc_layer_workspace &workspace, triangle_sink &sink)
 {
-	short unsigned int case_index = 0;
+	// Mapping waits for this buffer's readback to finish, but not for any later one.
+	glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pbo_handle);
 
-	// Note: default notation for MC -- small values (ie. false) are inside of the surface, large values (ie. true) are outside of the surface.
-	if(false == cube.value[0]) case_index |= 1;
-	if(false == cube.value[1]) case_index |= 2;
-	if(false == cube.value[2]) case_index |= 4;
-	if(false == cube.value[3]) case_index |= 8;
-	if(false == cube.value[4]) case_index |= 16;
-	if(false == cube.value[5]) case_index |= 32;
-	if(false == cube.value[6]) case_index |= 64;
-	if(false == cube.value[7]) case_index |= 128;
-
-	if(0 == mc_edge_table[case_index])
-		return 0;
+	const float *const output = static_cast<const float *>(glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY));
 
-	vertex_3 vertlist[12];
-
-	if(mc_edge_table[case_index] & 1)
+	if(0 != output)
 	{
-		size_t output_index = current_vertex_index*4;
-
-		vertlist[0].x = output[output_index + 0];
-		vertlist[0].y = output[output_index + 1];
-		vertlist[0].z = output[output_index + 2];
-
-		current_vertex_index++;
+		tesselate_cube_layer(fractal_set, cube_z, output, workspace, sink);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
 	}
 
-	if(mc_edge_table[case_index] & 2)
-	{
-		size_t output_index = current_vertex_index*4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+}
 
-		vertlist[1].x = output[output_index + 0];
-		vertlist[1].y = output[output_index + 1];
-		vertlist[1].z = output[output_index + 2];
+void quaternion_julia_set::tesselate_surface_net_layer(const voxel_grid &fractal_set, const size_t cube_z, const float *const output, mc_layer_workspace &workspace, triangle_sink &sink)
+{
+	const size_t cubes_per_side = res - 1;
+	const size_t cubes_per_layer = cubes_per_side*cubes_per_side;
 
-		current_vertex_index++;
-	}
+	if(workspace.cell_vertices.size() < 2*cubes_per_layer)
+		workspace.cell_vertices.resize(2*cubes_per_layer);
 
-	if(mc_edge_table[case_index] & 4)
-	{
-		size_t output_index = current_vertex_index*4;
+	// The layers take turns with the two halves of the cell vertices.
+	vertex_3 *const cells = &workspace.cell_vertices[(cube_z % 2)*cubes_per_layer];
+	const vertex_3 *const cells_below = &workspace.cell_vertices[((cube_z + 1) % 2)*cubes_per_layer];
 
-		vertlist[2].x = output[output_index + 0];
-		vertlist[2].y = output[output_index + 1];
-		vertlist[2].z = output[output_index + 2];
+	// Place a vertex in each cube that the surface passes through, at the mean of the vertices on its edges.
+	// The cubes are visited in Morton order, which is the order of the GPU's edge list.
+	size_t current_vertex_index = 0;
 
-		current_vertex_index++;
-	}
+	voxel_morton_iterator cubes(cubes_per_side);
+	size_t cube_x, cube_y;
 
-	if(mc_edge_table[case_index] & 8)
+	while(cubes.next(cube_x, cube_y))
 	{
-		size_t output_index = current_vertex_index*4;
-
-		vertlist[3].x = output[output_index + 0];
-		vertlist[3].y = output[output_index + 1];
-		vertlist[3].z = output[output_index + 2];
+		const mc_case &c = mc_cases[workspace.cases[cube_y*cubes_per_side + cube_x]];
 
-		current_vertex_index++;
-	}
+		if(0 == c.edge_count)
+			continue;
 
-	if(mc_edge_table[case_index] & 16)
-	{
-		size_t output_index = current_vertex_index*4;
+		vertex_3 sum;
 
-		vertlist[4].x = output[output_index + 0];
-		vertlist[4].y = output[output_index + 1];
-		vertlist[4].z = output[output_index + 2];
+		for(size_t k = 0; k < c.edge_count; k++, current_vertex_index++)
+			sum += vertex_3(output[current_vertex_index*4 + 0], output[current_vertex_index*4 + 1], output[current_vertex_index*4 + 2]);
 
-		current_vertex_index++;
+		cells[cube_y*cubes_per_side + cube_x] = sum*(1.0f/c.edge_count);
 	}
 
-	if(mc_edge_table[case_index] & 32)
-	{
-		size_t output_index = current_vertex_index*4;
+	// Join the four cubes around each edge that the surface crosses. The z edges run through this layer;
+	// the x and y edges lie on its bottom plane, between this layer and the one below.
+	// Each quad faces the way its edge runs when the low end is in the set, and the other way if not.
+	voxel_slab_iterator points(0, cubes_per_side);
+	size_t x, y;
 
-		vertlist[5].x = output[output_index + 0];
-		vertlist[5].y = output[output_index + 1];
-		vertlist[5].z = output[output_index + 2];
+	while(points.next(x, y))
+	{
+		const bool low_end = fractal_set.get(x, y, cube_z);
 
-		current_vertex_index++;
-	}
+		if(0 < x && 0 < y && low_end != fractal_set.get(x, y, cube_z + 1))
+		{
+			add_surface_net_quad(cells[(y - 1)*cubes_per_side + x - 1], cells[(y - 1)*cubes_per_side + x],
+								 cells[y*cubes_per_side + x], cells[y*cubes_per_side + x - 1], false == low_end, sink);
+		}
 
-	if(mc_edge_table[case_index] & 64)
-	{
-		size_t output_index = current_vertex_index*4;
+		if(0 == cube_z)
+			continue;
 
-		vertlist[6].x = output[output_index + 0];
-		vertlist[6].y = output[output_index + 1];
-		vertlist[6].z = output[output_index + 2];
+		if(0 < y && low_end != fractal_set.get(x + 1, y, cube_z))
+		{
+			add_surface_net_quad(cells_below[(y - 1)*cubes_per_side + x], cells_below[y*cubes_per_side + x],
+								 cells[y*cubes_per_side + x], cells[(y - 1)*cubes_per_side + x], false == low_end, sink);
+		}
 
-		current_vertex_index++;
+		if(0 < x && low_end != fractal_set.get(x, y + 1, cube_z))
+		{
+			add_surface_net_quad(cells_below[y*cubes_per_side + x - 1], cells[y*cubes_per_side + x - 1],
+								 cells[y*cubes_per_side + x], cells_below[y*cubes_per_side + x], false == low_end, sink);
+		}
 	}
+}
 
-	if(mc_edge_table[case_index] & 128)
-	{
-		size_t output_index = current_vertex_index*4;
-
-		vertlist[7].x = output[output_index + 0];
-		vertlist[7].y = output[output_index + 1];
-		vertlist[7].z = output[output_index + 2];
+void quaternion_julia_set::add_surface_net_quad(const vertex_3 &a, const vertex_3 &b, const vertex_3 &c, const vertex_3 &d, const bool reverse, triangle_sink &sink)
+{
+	triangle t;
 
-		current_vertex_index++;
-	}
+	t.vertex[0] = a;
+	t.vertex[1] = (true == reverse) ? c : b;
+	t.vertex[2] = (true == reverse) ? b : c;
+	sink.insert_triangle(t);
 
-	if(mc_edge_table[case_index] & 256)
-	{
-		size_t output_index = current_vertex_index*4;
+	t.vertex[0] = a;
+	t.vertex[1] = (true == reverse) ? d : c;
+	t.vertex[2] = (true == reverse) ? c : d;
+	sink.insert_triangle(t);
+}
 
-		vertlist[8].x = output[output_index + 0];
-		vertlist[8].y = output[output_index + 1];
-		vertlist[8].z = output[output_index + 2];
+void quaternion_julia_set::upload_slab_texture(const voxel_grid &fractal_set, const size_t z, const GLuint tex_handle, vector<unsigned char> &slab_bytes)
+{
+	slab_bytes.resize(res*res*2);
 
-		current_vertex_index++;
-	}
+	// Texel (x, y) holds grid points (x, y, z) and (x, y, z + 1).
+	voxel_slab_iterator slab(0, res);
+	size_t x, y;
 
-	if(mc_edge_table[case_index] & 512)
+	while(slab.next(x, y))
 	{
-		size_t output_index = current_vertex_index*4;
+		slab_bytes[(y*res + x)*2 + 0] = fractal_set.get(x, y, z) ? 255 : 0;
+		slab_bytes[(y*res + x)*2 + 1] = fractal_set.get(x, y, z + 1) ? 255 : 0;
+	}
 
-		vertlist[9].x = output[output_index + 0];
-		vertlist[9].y = output[output_index + 1];
-		vertlist[9].z = output[output_index + 2];
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, tex_handle);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, res, res, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, &slab_bytes[0]);
+	glActiveTexture(GL_TEXTURE0);
+}
 
-		current_vertex_index++;
-	}
+unsigned char quaternion_julia_set::get_cube_case_index(const voxel_grid &fractal_set, const size_t cube_x, const size_t cube_y, const size_t cube_z)
+{
+	unsigned int case_index = 0;
 
-	if(mc_edge_table[case_index] & 1024)
-	{
-		size_t output_index = current_vertex_index*4;
+	// Note: default notation for MC -- small values (ie. false) are inside of the surface, large values (ie. true) are outside of the surface.
+	// Bit i is set if corner i is in the set.
+	for(size_t corner = 0; corner < 8; corner++)
+		case_index |= static_cast<unsigned int>(fractal_set.get(cube_x + mc_corner_offsets[corner][0], cube_y + mc_corner_offsets[corner][1], cube_z + mc_corner_offsets[corner][2])) << corner;
 
-		vertlist[10].x = output[output_index + 0];
-		vertlist[10].y = output[output_index + 1];
-		vertlist[10].z = output[output_index + 2];
+	return static_cast<unsigned char>(case_index);
+}
 
-		current_vertex_index++;
-	}
+size_t quaternion_julia_set::get_edge_ids_from_cube(const unsigned char case_index, const size_t cube_x, const size_t cube_y, const size_t cube_z, mc_edge_id *const edges)
+{
+	const mc_case &c = get_case_table()[case_index];
 
-	if(mc_edge_table[case_index] & 2048)
+	// The edges go in edge order, which is the order that get_triangles_from_grid_cube() takes them in.
+	for(size_t k = 0; k < c.edge_count; k++)
 	{
-		size_t output_index = current_vertex_index*4;
+		const size_t edge = c.edges[k];
+		mc_edge_id &e = edges[k];
 
-		vertlist[11].x = output[output_index + 0];
-		vertlist[11].y = output[output_index + 1];
-		vertlist[11].z = output[output_index + 2];
-
-		current_vertex_index++;
+		e.x = static_cast<unsigned int>(cube_x + mc_cube_edge_ids[edge][0]);
+		e.y = static_cast<unsigned int>(cube_y + mc_cube_edge_ids[edge][1]);
+		e.z = static_cast<unsigned int>(cube_z + mc_cube_edge_ids[edge][2]);
+		e.direction = mc_cube_edge_ids[edge][3];
 	}
 
-	short unsigned int num_tris = 0;
+	return c.edge_count;
+}
+
+short unsigned int quaternion_julia_set::get_triangles_from_grid_cube(const unsigned char case_index, const float *const output, size_t &current_vertex_index, triangle *const triangles)
+{
+	const mc_case &c = get_case_table()[case_index];
+
+	// This cube's vertices are the next c.edge_count entries of the output, in edge order.
+	const float *const vertices = &output[current_vertex_index*4];
 
-	for(short unsigned int i = 0; mc_tri_table[case_index][i] != -1; i += 3)
+	for(size_t i = 0; i < c.triangle_count; i++)
 	{
-		triangles[num_tris].vertex[0] = vertlist[mc_tri_table[case_index][i    ]];
-		triangles[num_tris].vertex[1] = vertlist[mc_tri_table[case_index][i + 1]];
-		triangles[num_tris].vertex[2] = vertlist[mc_tri_table[case_index][i + 2]];
+		for(size_t j = 0; j < 3; j++)
+		{
+			const float *const v = &vertices[c.triangles[i*3 + j]*4];
 
-		num_tris++;
+			triangles[i].vertex[j].x = v[0];
+			triangles[i].vertex[j].y = v[1];
+			triangles[i].vertex[j].z = v[2];
+		}
 	}
 
-	return num_tris;
+	current_vertex_index += c.edge_count;
+
+	return c.triangle_count;
 }
 
-vertex_3 quaternion_julia_set::vertex_interp_float(vertex_3 v0, vertex_3 v1, float val_v0, float val_v1)
+vertex_3 quaternion_julia_set::vertex_interp(const mc_edge_id &edge, const bool low_end_outside)
 {
-	// Sort the vertices so that way the same two vertices will always produce the same result
-	// regardless of the order in which they were passed into the function.
-	//
-	// This may seem unnecessary, but adding two floats can produce different results depending
-	// on their order, if the very rightmost decimal places are in use.
-	if(v0 > v1)
-	{
-		vertex_3 temp(v0);
-		float temp_val = val_v0;
-
-		v0 = v1;
-		val_v0 = val_v1;
-
-		v1 = temp;
-		val_v1 = temp_val;
-	}
+	// The ends are only turned into floats here, from the edge id, so every cube that shares
+	// the edge gets bit-identical ends and there is no need to put them in a fixed order first.
+	const vertex_3 v0(grid_min + (edge.x * step_size), grid_min + (edge.y * step_size), grid_min + (edge.z * step_size));
+	const vertex_3 v1(grid_min + ((edge.x + (edge.direction & 1)) * step_size), grid_min + ((edge.y + ((edge.direction >> 1) & 1)) * step_size), grid_min + ((edge.z + ((edge.direction >> 2) & 1)) * step_size));
 
 	// Start half-way between the vertices.
 	vertex_3 result = (v0 + v1)*0.5f;
@@ -1612,8 +2751,8 @@ vertex_3 quaternion_julia_set::vertex_interp_float(vertex_3 v0, vertex_3 v1, flo
 	{
 		vertex_3 forward, backward;
 
-		// If p1 is outside of the surface and p2 is inside of the surface ...
-		if(val_v0 > val_v1)
+		// If v0 is outside of the surface and v1 is inside of the surface ...
+		if(true == low_end_outside)
 		{
 			forward = v0;
 			backward = v1;
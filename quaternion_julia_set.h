@@ -22,15 +22,29 @@
 //	#pragma comment(lib, "glut32")
 #endif
 
+// Define QJS_USE_EGL (and link with -lEGL) to be able to create the OpenGL context
+// without a window when there is no display, such as on a render node.
+// With Mesa, this runs the shaders on llvmpipe when there is no GPU.
+#ifdef QJS_USE_EGL
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+#endif
+
 
 
 #include "primitives.h"
 #include "mesh.h"
+#include "stl_stream.h"
+#include "voxel_grid.h"
 #include "marching_cubes.h"
-using marching_cubes::mc_grid_cube;
-using marching_cubes::max_triangles_per_mc_cell;
-using marching_cubes::mc_edge_table;
-using marching_cubes::mc_tri_table;
+using marching_cubes::mc_edge_id;
+using marching_cubes::max_triangles_per_mt_cell;
+using marching_cubes::max_edges_per_mt_cell;
+using marching_cubes::mc_case;
+using marching_cubes::mc_cases;
+using marching_cubes::mt_cases;
+using marching_cubes::mc_corner_offsets;
+using marching_cubes::mc_cube_edge_ids;
 
 #include "quaternion_math.h"
 #include "eqparse.h"
@@ -45,11 +59,13 @@ using string_utilities::is_unsigned_int;
 
 
 #include <cstring> // For memcpy()
+#include <cstdint>
 #include <ctime>
 
 #include <iostream>
 using std::cout;
 using std::endl;
+using std::ostream;
 
 
 #include <fstream>
@@ -79,6 +95,9 @@ using std::ios_base;
 #include <utility>
 using std::pair;
 
+#include <chrono>
+#include <atomic>
+
 
 class addsub_block
 {
@@ -100,6 +119,172 @@ public:
 };
 
 
+// A linked shader program, as returned by glGetProgramBinary, along with the source it was built from.
+class program_binary
+{
+public:
+	string fragment_shader_code;
+	GLenum format;
+	vector<char> binary;
+};
+
+// As with the compiled formula cache, enough for a parameter sweep without growing without bound.
+// Once full, the least recently used program is dropped.
+const size_t max_program_binary_cache_size = 64;
+
+
+// Everything that a configuration file holds, for callers that set up runs in code.
+class quaternion_julia_set_parameters
+{
+public:
+	quaternion_julia_set_parameters(void)
+	{
+		res = 100;
+		vertex_refinement_steps = 8;
+		shell_thickness = 0;
+		grid_min = -1.5f;
+		grid_max = 1.5f;
+		max_iterations = 8;
+		threshold = 4;
+		z_w = 0;
+		C.x = 0.3f;
+		C.y = 0.5f;
+		C.z = 0.4f;
+		C.w = 0.2f;
+		equation_text = "Z = sin(Z) + C * sin(Z)";
+	}
+
+	size_t res;
+	size_t vertex_refinement_steps;
+	float shell_thickness;
+	float grid_min;
+	float grid_max;
+	short unsigned int max_iterations;
+	float threshold;
+	float z_w;
+	quaternion C;
+	string equation_text;
+	vector<addsub_block> addsub_blocks;
+};
+
+
+// Scratch space for tesselating one layer of cubes at a time. It lives for the whole sweep,
+// and is only grown when a layer needs more room than any layer before it.
+class mc_layer_workspace
+{
+public:
+	void reserve(const size_t grid_res, const size_t edge_count)
+	{
+		if(cases.size() < (grid_res - 1)*(grid_res - 1))
+		{
+			cases.resize((grid_res - 1)*(grid_res - 1));
+			case_values.resize((grid_res - 1)*(grid_res - 1));
+		}
+
+		// Seven edge directions on each of the two planes of grid points that a layer of cubes touches.
+		if(edge_slots.size() < 14*grid_res*grid_res)
+			edge_slots.resize(14*grid_res*grid_res, 0);
+
+		if(edges.size() < edge_count)
+		{
+			edges.resize(edge_count);
+			first_uses.resize(edge_count);
+			output.resize(edge_count*4);
+		}
+	}
+
+	// The case index of each cube of the layer, row by row, found once and used by every pass.
+	vector<unsigned char> cases;
+
+	// The case indices as read back from the base of the GPU's pyramid.
+	vector<float> case_values;
+
+	// The edges that cross the surface, one entry per cube that uses them, and the vertex found
+	// on each of them (four floats per vertex: 3 for vertex position, 1 unused).
+	vector<mc_edge_id> edges;
+	vector<float> output;
+
+	// For each entry of the edge list, the first entry with the same edge; only that one is interpolated.
+	vector<unsigned int> first_uses;
+
+	// The entry that last named each edge of the layer. A slot is only trusted if it points at an entry
+	// of the current layer with the same edge, so the slots never need to be cleared.
+	vector<unsigned int> edge_slots;
+
+	// The slab bytes uploaded to the GPU.
+	vector<unsigned char> slab_bytes;
+
+	// For surface nets, the vertex of each cube of this layer and the layer before.
+	vector<vertex_3> cell_vertices;
+};
+
+
+// How tesselate_set() turns the voxel grid into triangles.
+enum tesselation_method
+{
+	// Paul Bourke's tables. The ambiguous cases are not resolved the same way on both sides
+	// of every face, so the mesh can have cracks.
+	MARCHING_CUBES,
+
+	// Each cube is split into six tetrahedra, which have no ambiguous cases. The mesh is always
+	// closed and manifold, at the cost of about three times as many triangles.
+	MARCHING_TETRAHEDRA,
+
+	// Naive surface nets: one vertex per cube that the surface passes through, at the mean of
+	// the refined vertices on its edges, and one quad across each edge that the surface crosses.
+	// The triangles are much better shaped, but the mesh is not always manifold.
+	SURFACE_NETS
+};
+
+
+// The options for one run, as given on the command line or on a job file's option line.
+class quaternion_julia_set_run_options
+{
+public:
+	quaternion_julia_set_run_options(void)
+	{
+		stream_output = false;
+		memory_mapped_grids = false;
+		periodicity_checking = false;
+		progressive = false;
+		verify_output = false;
+		method = MARCHING_CUBES;
+		time_budget_seconds = 0;
+	}
+
+	// Reads the option at args[i], and the value after it if it takes one, leaving i on the last argument used.
+	// Options can be written as -name, /name or name. Returns false for an unknown option or a missing value.
+	bool parse_option(const vector<string> &args, size_t &i);
+
+	bool stream_output;
+	bool memory_mapped_grids;
+	bool periodicity_checking;
+	bool progressive;
+	bool verify_output;
+	tesselation_method method;
+	double time_budget_seconds;
+};
+
+
+// Called as each stage moves along, with the fraction of that stage done so far (checked once per slab).
+// Return false to cancel the run.
+typedef bool (*progress_callback)(const char *const stage_name, const float fraction, void *user_data);
+
+
+// Lets another thread stop a run; the run notices at the next slab.
+class cancellation_token
+{
+public:
+	cancellation_token(void) : cancelled(false) {}
+
+	inline void cancel(void) { cancelled = true; }
+	inline bool is_cancelled(void) const { return cancelled; }
+
+protected:
+	std::atomic<bool> cancelled;
+};
+
+
 class quaternion_julia_set
 {
 public:
@@ -107,8 +292,12 @@ public:
 	~quaternion_julia_set(void);
 
 	bool load_configuration_from_file(const char *file_name);
+	bool set_parameters(const quaternion_julia_set_parameters &p);
 	bool generate_and_write_isosurface_to_binary_stl_file(const char *file_name);
 
+	// Produces the mesh in memory, without writing any files.
+	bool generate_isosurface(indexed_mesh &m);
+
 	inline size_t get_res(void) { return res; };
 	inline size_t get_vertex_refinement_steps(void) { return vertex_refinement_steps; };
 	inline float get_shell_thickness(void) { return shell_thickness; };
@@ -123,22 +312,69 @@ public:
 	inline float get_C_w(void) { return C.w; };
 	inline string get_equation_text(void) { return equation_text; }
 	inline string get_status_string(void) { return status_string; }
+	inline const vector<pair<string, double> > &get_stage_timings(void) { return stage_timings; }
+	size_t get_estimated_grid_bytes(void);
+	size_t get_estimated_mesh_bytes(void);
+	void set_run_options(const quaternion_julia_set_run_options &options);
+	inline void set_stream_output(const bool src_stream_output) { stream_output = src_stream_output; }
+	inline void set_memory_mapped_grids(const bool src_memory_mapped_grids) { memory_mapped_grids = src_memory_mapped_grids; }
+	inline void set_progressive(const bool src_progressive) { progressive = src_progressive; }
+	inline void set_verify_output(const bool src_verify_output) { verify_output = src_verify_output; } // Read .qjm files back after writing them.
+	inline void set_tesselation_method(const tesselation_method src_method) { method = src_method; }
+	inline void set_shader_cache_directory(const string &src_directory) { shader_cache_directory = src_directory; }
+	inline void set_write_shader_files(const bool src_write_shader_files) { write_shader_files = src_write_shader_files; }
+	inline void set_progress_callback(progress_callback src_function, void *src_user_data) { progress_function = src_function; progress_user_data = src_user_data; }
+	void set_log_stream(ostream *const dest); // Pass 0 to silence all progress messages.
+	inline void set_cancellation_token(const cancellation_token *const src_token) { cancel_token = src_token; }
+
+	// With a budget in seconds, runs that would overrun it are scaled back: the grid resolution is lowered
+	// if generating the set alone would take more than half of it, and vertex refinement is skipped
+	// if half of it is gone by the time tesselation starts. 0 disables the budget.
+	inline void set_time_budget(const double src_seconds) { time_budget_seconds = src_seconds; }
+	inline void set_periodicity_epsilon(const float src_epsilon) { eqparser.set_periodicity_epsilon(src_epsilon); }
 	string get_blocks_string(void);
 
 protected:
 	bool setup_equation_text(const string &src_formula_text, string &error_string);
+#ifdef QJS_USE_EGL
+	bool create_headless_context(void);
+#endif
 	bool initialize_fragment_shader(const string &fragment_shader_code, GLint &shader);
-	bool generate_fractal_set(vector<bool> &fractal_set);
-	void get_surface_set(const vector<bool> &fractal_set, vector<bool> &surface);
-	void thicken_shell(const vector<bool> &fractal_set, vector<bool> &shell);
-	void add_to_set(vector<bool> &fractal_set, const addsub_block &b);
-	void subtract_from_set(vector<bool> &fractal_set, const addsub_block &b);
-
-	void init_grid_cube(mc_grid_cube &cube, const size_t cube_x, const size_t cube_y, const size_t cube_z, const vector<bool> &fractal_set);
-	bool tesselate_set(const vector<bool> &fractal_set, indexed_mesh &m);
-	void get_vertex_interp_input_from_grid_cube(const mc_grid_cube &cube, vector<float> &input0, vector<float> &input1);
-	short unsigned int get_triangles_from_grid_cube(const mc_grid_cube &cube, vector<float> &output, size_t &current_vertex_index, triangle *const triangles);
-	vertex_3 vertex_interp_float(vertex_3 v0, vertex_3 v1, float val_v0, float val_v1);
+	bool load_program_binary(const string &fragment_shader_code, GLint &shader);
+	void store_program_binary(const string &fragment_shader_code, const GLint shader);
+	void cache_program_binary(const program_binary &pb);
+	string get_program_binary_file_name(const string &fragment_shader_code);
+	bool allocate_grid(voxel_grid &grid, const char *const file_name, const size_t grid_res = 0); // A grid_res of 0 means res.
+	bool generate_voxel_set(voxel_grid &fractal_set, const char *const file_name);
+	bool report_progress(const char *const stage_name, const float fraction);
+	void begin_run(void);
+	double get_run_seconds(void);
+	bool check_set_generation_budget(const std::chrono::steady_clock::time_point &pass_start_time, const size_t slabs_done);
+	bool check_projected_set_generation_time(const double pass_seconds, const double projected_seconds);
+	bool generate_fractal_set(voxel_grid &fractal_set);
+	void store_slab_mask(voxel_grid &fractal_set, const size_t z, const unsigned char *const mask, const size_t row_stride);
+	void store_atlas_masks(voxel_grid &fractal_set, const size_t first_z, const size_t slab_count, const size_t tile_columns, const unsigned char *const atlas);
+	void store_atlas_masks_from_pixel_buffer(voxel_grid &fractal_set, const size_t first_z, const size_t slab_count, const size_t tile_columns, const GLuint pbo_handle);
+	bool generate_fractal_set_progressively(voxel_grid &fractal_set, const char *const file_name);
+	void find_inferable_cells(const voxel_grid &fractal_set, const size_t coarse_stride, const size_t cell_count, voxel_grid &inferable);
+	bool write_progressive_preview(const voxel_grid &fractal_set, const size_t stride, const string &preview_file_name);
+	void get_surface_set(const voxel_grid &fractal_set, voxel_grid &surface);
+	bool thicken_shell(const voxel_grid &fractal_set, voxel_grid &shell, const char *const file_name, const size_t pass, const size_t pass_count);
+	void add_to_set(voxel_grid &fractal_set, const addsub_block &b);
+	void subtract_from_set(voxel_grid &fractal_set, const addsub_block &b);
+
+	bool tesselate_set(const voxel_grid &fractal_set, triangle_sink &sink, const char *const stage_name);
+	void tesselate_cube_layer(const voxel_grid &fractal_set, const size_t cube_z, const float *const output, mc_layer_workspace &workspace, triangle_sink &sink);
+	void tesselate_pixel_buffer_layer(const voxel_grid &fractal_set, const size_t cube_z, const GLuint pbo_handle, mc_layer_workspace &workspace, triangle_sink &sink);
+	void tesselate_surface_net_layer(const voxel_grid &fractal_set, const size_t cube_z, const float *const output, mc_layer_workspace &workspace, triangle_sink &sink);
+	void add_surface_net_quad(const vertex_3 &a, const vertex_3 &b, const vertex_3 &c, const vertex_3 &d, const bool reverse, triangle_sink &sink);
+	void upload_slab_texture(const voxel_grid &fractal_set, const size_t z, const GLuint tex_handle, vector<unsigned char> &slab_bytes);
+	unsigned char get_cube_case_index(const voxel_grid &fractal_set, const size_t cube_x, const size_t cube_y, const size_t cube_z);
+	size_t get_edge_ids_from_cube(const unsigned char case_index, const size_t cube_x, const size_t cube_y, const size_t cube_z, mc_edge_id *const edges);
+	short unsigned int get_triangles_from_grid_cube(const unsigned char case_index, const float *const output, size_t &current_vertex_index, triangle *const triangles);
+	vertex_3 vertex_interp(const mc_edge_id &edge, const bool low_end_outside);
+	inline const mc_case *get_case_table(void) const { return (MARCHING_TETRAHEDRA == method) ? mt_cases : mc_cases; }
+	void record_stage_time(const char *const stage_name);
 
 	size_t res;
 	size_t vertex_refinement_steps;
@@ -157,12 +393,46 @@ protected:
 	bool parameters_configured;
 
 	bool force_cpu;
+	bool stream_output;
+	bool memory_mapped_grids;
+	size_t grid_backing_file_count;
+	bool progressive;
+	bool verify_output;
+	tesselation_method method;
+	bool write_shader_files;
 	bool opengl_init_ok;
 	int glut_window_handle;
+	bool headless_context;
+
+#ifdef QJS_USE_EGL
+	EGLDisplay egl_display;
+	EGLContext egl_context;
+#endif
 
 	quaternion_julia_set_equation_parser eqparser;
 
+	// Linked shader programs from earlier runs, so that repeated jobs skip compiling and linking.
+	vector<program_binary> program_binaries;
+	string shader_cache_directory;
+
 	string status_string;
+
+	ostream log_output;
+	progress_callback progress_function;
+	void *progress_user_data;
+	const cancellation_token *cancel_token;
+
+	double time_budget_seconds;
+	size_t configured_res;
+	size_t configured_vertex_refinement_steps;
+	bool reduced_res_for_budget;
+
+	time_t start_time;
+	std::chrono::steady_clock::time_point run_start_time;
+
+	// Wall-clock seconds spent in each stage of the last run.
+	vector<pair<string, double> > stage_timings;
+	std::chrono::steady_clock::time_point stage_start_time;
 };
 
 
@@ -0,0 +1,190 @@
+#include "range_coder.h"
+
+
+static const unsigned int probability_bits = 11;
+static const unsigned int probability_one = 1 << probability_bits;
+static const unsigned int adaptation_shift = 5;
+static const unsigned int top_value = 1 << 24;
+
+
+adaptive_byte_model::adaptive_byte_model(void)
+{
+	for(size_t i = 0; i < 256; i++)
+		probabilities[i] = probability_one / 2;
+}
+
+
+range_encoder::range_encoder(vector<unsigned char> &dest) : out(dest)
+{
+	low = 0;
+	range = 0xffffffff;
+	cache = 0;
+	cache_size = 1;
+}
+
+void range_encoder::encode_bit(short unsigned int &probability, const unsigned int bit)
+{
+	const unsigned int bound = (range >> probability_bits) * probability;
+
+	if(0 == bit)
+	{
+		range = bound;
+		probability += (probability_one - probability) >> adaptation_shift;
+	}
+	else
+	{
+		low += bound;
+		range -= bound;
+		probability -= probability >> adaptation_shift;
+	}
+
+	while(range < top_value)
+	{
+		range <<= 8;
+		shift_low();
+	}
+}
+
+void range_encoder::shift_low(void)
+{
+	// Hold back 0xff bytes until we know whether a carry will propagate into them.
+	if(static_cast<unsigned int>(low) < 0xff000000 || 0 != (low >> 32))
+	{
+		unsigned char temp = cache;
+
+		do
+		{
+			out.push_back(static_cast<unsigned char>(temp + static_cast<unsigned char>(low >> 32)));
+			temp = 0xff;
+		}
+		while(0 != --cache_size);
+
+		cache = static_cast<unsigned char>(low >> 24);
+	}
+
+	cache_size++;
+	low = (low & 0x00ffffff) << 8;
+}
+
+void range_encoder::encode_byte(adaptive_byte_model &model, const unsigned char byte)
+{
+	// Walk the bit tree from the most significant bit down.
+	unsigned int node = 1;
+
+	for(int i = 7; i >= 0; i--)
+	{
+		const unsigned int bit = (byte >> i) & 1;
+		encode_bit(model.probabilities[node], bit);
+		node = (node << 1) | bit;
+	}
+}
+
+void range_encoder::encode_varint(adaptive_byte_model *const models, const size_t model_count, unsigned long long value)
+{
+	// Seven bits per byte, high bit set on all but the last byte. Each byte position has its own model.
+	size_t model_index = 0;
+
+	do
+	{
+		unsigned char byte = static_cast<unsigned char>(value & 0x7f);
+		value >>= 7;
+
+		if(0 != value)
+			byte |= 0x80;
+
+		encode_byte(models[model_index], byte);
+
+		if(model_index < model_count - 1)
+			model_index++;
+	}
+	while(0 != value);
+}
+
+void range_encoder::flush(void)
+{
+	for(size_t i = 0; i < 5; i++)
+		shift_low();
+}
+
+
+range_decoder::range_decoder(const unsigned char *const src, const size_t src_size)
+{
+	in = src;
+	in_size = src_size;
+	in_pos = 0;
+	range = 0xffffffff;
+	code = 0;
+	ok = true;
+
+	for(size_t i = 0; i < 5; i++)
+		code = (code << 8) | next_byte();
+}
+
+unsigned char range_decoder::next_byte(void)
+{
+	if(in_pos >= in_size)
+	{
+		ok = false;
+		return 0;
+	}
+
+	return in[in_pos++];
+}
+
+unsigned int range_decoder::decode_bit(short unsigned int &probability)
+{
+	const unsigned int bound = (range >> probability_bits) * probability;
+	unsigned int bit;
+
+	if(code < bound)
+	{
+		range = bound;
+		probability += (probability_one - probability) >> adaptation_shift;
+		bit = 0;
+	}
+	else
+	{
+		code -= bound;
+		range -= bound;
+		probability -= probability >> adaptation_shift;
+		bit = 1;
+	}
+
+	while(range < top_value)
+	{
+		range <<= 8;
+		code = (code << 8) | next_byte();
+	}
+
+	return bit;
+}
+
+unsigned char range_decoder::decode_byte(adaptive_byte_model &model)
+{
+	unsigned int node = 1;
+
+	for(size_t i = 0; i < 8; i++)
+		node = (node << 1) | decode_bit(model.probabilities[node]);
+
+	return static_cast<unsigned char>(node & 0xff);
+}
+
+unsigned long long range_decoder::decode_varint(adaptive_byte_model *const models, const size_t model_count)
+{
+	unsigned long long value = 0;
+	size_t model_index = 0;
+
+	for(unsigned int shift = 0; shift < 64; shift += 7)
+	{
+		const unsigned char byte = decode_byte(models[model_index]);
+		value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+
+		if(0 == (byte & 0x80))
+			break;
+
+		if(model_index < model_count - 1)
+			model_index++;
+	}
+
+	return value;
+}
@@ -0,0 +1,62 @@
+#ifndef RANGE_CODER_H
+#define RANGE_CODER_H
+
+#include <vector>
+using std::vector;
+
+#include <cstddef>
+
+
+// Adaptive binary range coder, in the style of the one used by LZMA.
+// Bytes are coded as eight binary decisions down a 256-leaf tree, each with its own adaptive probability.
+class adaptive_byte_model
+{
+public:
+	adaptive_byte_model(void);
+
+	short unsigned int probabilities[256];
+};
+
+class range_encoder
+{
+public:
+	range_encoder(vector<unsigned char> &dest);
+
+	void encode_byte(adaptive_byte_model &model, const unsigned char byte);
+	void encode_varint(adaptive_byte_model *const models, const size_t model_count, unsigned long long value);
+	void flush(void);
+
+protected:
+	void encode_bit(short unsigned int &probability, const unsigned int bit);
+	void shift_low(void);
+
+	vector<unsigned char> &out;
+	unsigned long long low;
+	unsigned int range;
+	unsigned char cache;
+	unsigned long long cache_size;
+};
+
+class range_decoder
+{
+public:
+	range_decoder(const unsigned char *const src, const size_t src_size);
+
+	unsigned char decode_byte(adaptive_byte_model &model);
+	unsigned long long decode_varint(adaptive_byte_model *const models, const size_t model_count);
+	inline bool is_ok(void) { return ok; }
+
+protected:
+	unsigned int decode_bit(short unsigned int &probability);
+	unsigned char next_byte(void);
+
+	const unsigned char *in;
+	size_t in_size;
+	size_t in_pos;
+	unsigned int range;
+	unsigned int code;
+	bool ok;
+};
+
+
+#endif
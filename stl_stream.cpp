@@ -0,0 +1,92 @@
+#include "stl_stream.h"
+
+
+stereo_lithography_stream::stereo_lithography_stream(const char *const src_file_name, const size_t src_buffer_width)
+{
+	file_name = src_file_name;
+	buffer_width = src_buffer_width;
+	buffer_count = 0;
+	triangle_count = 0;
+	ok = false;
+}
+
+void stereo_lithography_stream::init_triangle_insertion(void)
+{
+	buffer_count = 0;
+	triangle_count = 0;
+
+	out.open(file_name, ios_base::binary | ios_base::trunc);
+
+	if(out.fail())
+	{
+		ok = false;
+		return;
+	}
+
+	// Write blank header, and a placeholder for the number of triangles.
+	vector<char> header(stl_header_size + sizeof(unsigned int), 0);
+	out.write(&header[0], header.size());
+
+	buffer.resize(stl_per_triangle_data_size * buffer_width, 0);
+
+	ok = !out.fail();
+}
+
+void stereo_lithography_stream::insert_triangle(const triangle &src_tri)
+{
+	if(false == ok)
+		return;
+
+	vertex_3 normal = (src_tri.vertex[1] - src_tri.vertex[0]).cross(src_tri.vertex[2] - src_tri.vertex[0]);
+	normal.normalize();
+
+	const float record[12] = { normal.x, normal.y, normal.z,
+							   src_tri.vertex[0].x, src_tri.vertex[0].y, src_tri.vertex[0].z,
+							   src_tri.vertex[1].x, src_tri.vertex[1].y, src_tri.vertex[1].z,
+							   src_tri.vertex[2].x, src_tri.vertex[2].y, src_tri.vertex[2].z };
+
+	// The attribute byte count stays zero from when the buffer was allocated.
+	memcpy(&buffer[stl_per_triangle_data_size*buffer_count], record, sizeof(record));
+
+	buffer_count++;
+	triangle_count++;
+
+	// If buffer is full, write triangles in buffer to disk.
+	if(buffer_count == buffer_width)
+		flush_buffer();
+}
+
+void stereo_lithography_stream::finalize_triangle_insertion(void)
+{
+	if(false == ok)
+		return;
+
+	// Write any remaining triangles in buffer to disk.
+	flush_buffer();
+
+	// The triangle count must be a 4-byte unsigned int.
+	if(triangle_count > 0xffffffff)
+		ok = false;
+
+	const unsigned int num_triangles = static_cast<unsigned int>(triangle_count);
+
+	out.seekp(stl_header_size);
+	out.write(reinterpret_cast<const char *>(&num_triangles), sizeof(unsigned int));
+	out.close();
+
+	if(out.fail())
+		ok = false;
+}
+
+void stereo_lithography_stream::flush_buffer(void)
+{
+	if(0 == buffer_count)
+		return;
+
+	out.write(&buffer[0], stl_per_triangle_data_size*buffer_count);
+
+	if(out.fail())
+		ok = false;
+
+	buffer_count = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef STL_STREAM_H
+#define STL_STREAM_H
+
+#include "primitives.h"
+#include "mesh.h"
+
+#include <fstream>
+using std::ofstream;
+
+#include <ios>
+using std::ios_base;
+
+#include <vector>
+using std::vector;
+
+#include <cstring> // for memcpy()
+
+
+// Writes triangles straight to a binary Stereo Lithography file as they arrive, without welding them into an indexed mesh.
+// The triangle count in the header is patched in once insertion is finalized.
+class stereo_lithography_stream : public triangle_sink
+{
+public:
+	stereo_lithography_stream(const char *const src_file_name, const size_t src_buffer_width = 65536);
+
+	void init_triangle_insertion(void);
+	void insert_triangle(const triangle &src_tri);
+	void finalize_triangle_insertion(void);
+
+	inline bool is_ok(void) { return ok; }
+	inline size_t get_triangle_count(void) { return triangle_count; }
+
+protected:
+	void flush_buffer(void);
+
+	const char *file_name;
+	ofstream out;
+	vector<char> buffer;
+	size_t buffer_width;
+	size_t buffer_count;
+	size_t triangle_count;
+	bool ok;
+};
+
+
+#endif
@@ -0,0 +1,173 @@
+#include "voxel_grid.h"
+
+
+voxel_grid::voxel_grid(void)
+{
+	res = 0;
+	bricks_per_axis = 0;
+	word_count = 0;
+	words = 0;
+	mapping = 0;
+	mapping_size = 0;
+}
+
+voxel_grid::~voxel_grid(void)
+{
+	release();
+}
+
+bool voxel_grid::allocate(const size_t src_res, const string &src_backing_file_name)
+{
+	release();
+
+	// Round each axis up to whole bricks; each brick is voxel_brick_size words.
+	const size_t src_bricks_per_axis = (src_res + voxel_brick_mask) >> voxel_brick_shift;
+	const size_t src_word_count = src_bricks_per_axis*src_bricks_per_axis*src_bricks_per_axis*voxel_brick_size;
+
+	if("" == src_backing_file_name)
+	{
+		memory_words.resize(src_word_count, 0);
+		words = (0 < src_word_count) ? &memory_words[0] : 0;
+	}
+	else
+	{
+#ifdef QJS_HAVE_MMAP
+		const size_t src_mapping_size = src_word_count*sizeof(unsigned long long);
+
+		int fd = open(src_backing_file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+		if(-1 == fd)
+			return false;
+
+		// The file is only scratch space: unlink it right away, so that it disappears once unmapped.
+		unlink(src_backing_file_name.c_str());
+
+		// A freshly truncated file reads back as zeroes, so the grid starts out empty.
+		if(0 != ftruncate(fd, src_mapping_size))
+		{
+			close(fd);
+			return false;
+		}
+
+		void *src_mapping = mmap(0, src_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+		// The mapping keeps the file alive.
+		close(fd);
+
+		if(MAP_FAILED == src_mapping)
+			return false;
+
+		mapping = src_mapping;
+		mapping_size = src_mapping_size;
+		words = static_cast<unsigned long long *>(mapping);
+#else
+		// No memory mapping support on this platform -- fall back to RAM.
+		memory_words.resize(src_word_count, 0);
+		words = (0 < src_word_count) ? &memory_words[0] : 0;
+#endif
+	}
+
+	res = src_res;
+	bricks_per_axis = src_bricks_per_axis;
+	word_count = src_word_count;
+
+	return true;
+}
+
+void voxel_grid::release(void)
+{
+#ifdef QJS_HAVE_MMAP
+	if(0 != mapping)
+		munmap(mapping, mapping_size);
+#endif
+
+	mapping = 0;
+	mapping_size = 0;
+
+	vector<unsigned long long>().swap(memory_words);
+	words = 0;
+	word_count = 0;
+	bricks_per_axis = 0;
+	res = 0;
+}
+
+bool voxel_grid::copy_from(const voxel_grid &src)
+{
+	if(res != src.res)
+		return false;
+
+	if(0 < word_count)
+		memcpy(words, src.words, word_count*sizeof(unsigned long long));
+
+	return true;
+}
+
+void voxel_grid::swap(voxel_grid &other)
+{
+	std::swap(res, other.res);
+	std::swap(bricks_per_axis, other.bricks_per_axis);
+	std::swap(word_count, other.word_count);
+	std::swap(mapping, other.mapping);
+	std::swap(mapping_size, other.mapping_size);
+	memory_words.swap(other.memory_words);
+
+	// Re-point the words at the swapped storage.
+	words = (0 != mapping) ? static_cast<unsigned long long *>(mapping) : ((0 < memory_words.size()) ? &memory_words[0] : 0);
+	other.words = (0 != other.mapping) ? static_cast<unsigned long long *>(other.mapping) : ((0 < other.memory_words.size()) ? &other.memory_words[0] : 0);
+}
+
+void voxel_grid::advise_sweep_position(const size_t z, const size_t lookahead) const
+{
+	if(0 == mapping)
+		return;
+
+#ifdef QJS_HAVE_MMAP
+	advise_slabs(z + 1, z + 1 + lookahead, MADV_WILLNEED);
+
+	// Keep the previous slab around, since neighbourhood queries still look at it.
+	if(z >= 2)
+		advise_slabs(0, z - 1, MADV_DONTNEED);
+#endif
+}
+
+void voxel_grid::advise_slabs(size_t z_begin, size_t z_end, const int advice) const
+{
+#ifdef QJS_HAVE_MMAP
+	if(z_end > res)
+		z_end = res;
+
+	if(z_begin >= z_end)
+		return;
+
+	// Slabs are stored a layer of bricks at a time.
+	const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t brick_layer_size = bricks_per_axis*bricks_per_axis*voxel_brick_size*sizeof(unsigned long long);
+	size_t layer_begin = z_begin >> voxel_brick_shift;
+	size_t layer_end = (z_end + voxel_brick_mask) >> voxel_brick_shift;
+
+	// Only release brick layers that lie entirely within the range.
+	if(MADV_DONTNEED == advice)
+	{
+		layer_begin = (z_begin + voxel_brick_mask) >> voxel_brick_shift;
+		layer_end = z_end >> voxel_brick_shift;
+	}
+
+	size_t byte_begin = layer_begin*brick_layer_size;
+	size_t byte_end = layer_end*brick_layer_size;
+
+	// madvise() needs a page-aligned start.
+	byte_begin -= byte_begin % page_size;
+
+	if(byte_end > mapping_size)
+		byte_end = mapping_size;
+
+	// Only release pages that lie entirely within the range.
+	if(MADV_DONTNEED == advice)
+		byte_end -= byte_end % page_size;
+
+	if(byte_begin >= byte_end)
+		return;
+
+	madvise(static_cast<char *>(mapping) + byte_begin, byte_end - byte_begin, advice);
+#endif
+}
@@ -0,0 +1,212 @@
+#ifndef VOXEL_GRID_H
+#define VOXEL_GRID_H
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include <algorithm> // for swap()
+
+#include <cstring> // for memcpy()
+#include <cstddef>
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+	#define QJS_HAVE_MMAP
+#endif
+
+
+// A res x res x res occupancy grid, one bit per voxel.
+// The bits live either in RAM, or in a memory-mapped file so that grids larger than RAM
+// can be swept through slab by slab, with the operating system paging them in and out.
+//
+// Voxels are stored in 8 x 8 x 8 bricks of 512 bits, which is one 64-byte cache line.
+// Within a brick, each z-layer is one 64-bit word (y major, x minor). Bricks are ordered with
+// z slowest, then y, then x, so that a sweep along z still touches one contiguous region at a time,
+// and all 27 neighbours of a voxel usually fall within one or two cache lines.
+const size_t voxel_brick_size = 8;
+const size_t voxel_brick_shift = 3;
+const size_t voxel_brick_mask = voxel_brick_size - 1;
+
+class voxel_grid
+{
+public:
+	voxel_grid(void);
+	~voxel_grid(void);
+
+	// An empty backing file name keeps the grid in RAM.
+	bool allocate(const size_t src_res, const string &src_backing_file_name = "");
+	void release(void);
+	bool copy_from(const voxel_grid &src);
+	void swap(voxel_grid &other);
+
+	inline size_t get_res(void) const { return res; }
+	inline bool is_memory_mapped(void) const { return 0 != mapping; }
+
+	inline bool get(const size_t x, const size_t y, const size_t z) const
+	{
+		return 0 != ((words[get_word_index(x, y, z)] >> get_bit_index(x, y)) & 1);
+	}
+
+	inline void set(const size_t x, const size_t y, const size_t z, const bool value)
+	{
+		const unsigned long long mask = 1ULL << get_bit_index(x, y);
+
+		if(value)
+			words[get_word_index(x, y, z)] |= mask;
+		else
+			words[get_word_index(x, y, z)] &= ~mask;
+	}
+
+	// Hint that a sweep along z has reached slab z: upcoming slabs are prefetched,
+	// and slabs that are well behind are released back to the operating system.
+	void advise_sweep_position(const size_t z, const size_t lookahead = 2) const;
+
+protected:
+	voxel_grid(const voxel_grid &);
+	voxel_grid &operator=(const voxel_grid &);
+
+	inline size_t get_word_index(const size_t x, const size_t y, const size_t z) const
+	{
+		const size_t brick_index = ((z >> voxel_brick_shift)*bricks_per_axis + (y >> voxel_brick_shift))*bricks_per_axis + (x >> voxel_brick_shift);
+		return (brick_index << voxel_brick_shift) + (z & voxel_brick_mask);
+	}
+
+	inline size_t get_bit_index(const size_t x, const size_t y) const
+	{
+		return ((y & voxel_brick_mask) << voxel_brick_shift) + (x & voxel_brick_mask);
+	}
+
+	void advise_slabs(size_t z_begin, size_t z_end, const int advice) const;
+
+	size_t res;
+	size_t bricks_per_axis;
+	size_t word_count;
+	unsigned long long *words;
+
+	vector<unsigned long long> memory_words;
+	void *mapping;
+	size_t mapping_size;
+};
+
+
+// Walks the (x, y) positions of the square [begin, end) x [begin, end) one 8 x 8 tile at a time,
+// which is the order that voxel_grid stores the bits of a slab in.
+class voxel_slab_iterator
+{
+public:
+	voxel_slab_iterator(const size_t src_begin, const size_t src_end)
+	{
+		begin = src_begin;
+		end = src_end;
+		tile_x = tile_y = begin & ~voxel_brick_mask;
+		x = y = begin;
+		done = (begin >= end);
+	}
+
+	inline bool next(size_t &dest_x, size_t &dest_y)
+	{
+		if(done)
+			return false;
+
+		dest_x = x;
+		dest_y = y;
+
+		// Advance along x within the tile, then y within the tile, then to the next tile.
+		if(++x < tile_x + voxel_brick_size && x < end)
+			return true;
+
+		x = (tile_x > begin) ? tile_x : begin;
+
+		if(++y < tile_y + voxel_brick_size && y < end)
+			return true;
+
+		tile_x += voxel_brick_size;
+
+		if(tile_x >= end)
+		{
+			tile_x = begin & ~voxel_brick_mask;
+			tile_y += voxel_brick_size;
+
+			if(tile_y >= end)
+			{
+				done = true;
+				return true;
+			}
+		}
+
+		x = (tile_x > begin) ? tile_x : begin;
+		y = (tile_y > begin) ? tile_y : begin;
+
+		return true;
+	}
+
+protected:
+	size_t begin, end;
+	size_t tile_x, tile_y;
+	size_t x, y;
+	bool done;
+};
+
+// Visits every (x, y) of [0, end) x [0, end) in Morton (Z) order, with x as the low bit.
+// This is the order in which a histogram pyramid lists its cells, and since bricks
+// are aligned to powers of two, each brick of a slab is still visited in one run.
+class voxel_morton_iterator
+{
+public:
+	voxel_morton_iterator(const size_t src_end)
+	{
+		end = src_end;
+		side = 1;
+
+		while(side < end)
+			side *= 2;
+
+		index = 0;
+	}
+
+	inline bool next(size_t &dest_x, size_t &dest_y)
+	{
+		while(index < side*side)
+		{
+			const size_t x = static_cast<size_t>(compact_even_bits(index));
+			const size_t y = static_cast<size_t>(compact_even_bits(index >> 1));
+
+			index++;
+
+			// The square is rounded up to a power of two; skip what lies past the end.
+			if(x < end && y < end)
+			{
+				dest_x = x;
+				dest_y = y;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+protected:
+	// Gathers bits 0, 2, 4, ... of v into bits 0, 1, 2, ...
+	static inline unsigned long long compact_even_bits(unsigned long long v)
+	{
+		v &= 0x5555555555555555ULL;
+		v = (v | (v >> 1)) & 0x3333333333333333ULL;
+		v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+		v = (v | (v >> 4)) & 0x00ff00ff00ff00ffULL;
+		v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+		v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+
+		return v;
+	}
+
+	size_t end, side;
+	size_t index;
+};
+
+
+#endif